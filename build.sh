@@ -5,7 +5,7 @@ export PDAL_JULIA_RUNTIME_PATH=/usr/local/lib
 
 # julia build_sys.jl
 sudo cp ./pdal/pdal_jl_sys.so $PDAL_DRIVER_PATH
-sudo cp ./jl/PdalJulia.jl $PDAL_JULIA_RUNTIME_PATH
+sudo cp ./jl/PdalJulia/src/PdalJulia.jl $PDAL_JULIA_RUNTIME_PATH
 
 # rm -rf pdal/build
 # mkdir pdal/build
@@ -7,9 +7,12 @@ Pkg.add("AcceleratedArrays")
 Pkg.add("StructArrays")
 Pkg.add("StaticArrays")
 
+# The stage runtime is compiled into the sysimage as a package of its own
+Pkg.develop(PackageSpec(path="jl/PdalJulia"))
+
 using PackageCompiler
 
-packages = [:TypedTables, :RoamesGeometry, :AcceleratedArrays, :StructArrays, :StaticArrays]
+packages = [:TypedTables, :RoamesGeometry, :AcceleratedArrays, :StructArrays, :StaticArrays, :PdalJulia]
 
 create_sysimage(packages, sysimage_path="pdal/pdal_jl_sys.so", precompile_execution_file="jl/Import.jl")
 
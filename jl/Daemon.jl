@@ -0,0 +1,155 @@
+#
+# A long-lived Julia process that runs filters.julia functions for PDAL, so that jobs don't each pay
+# for starting Julia and compiling their script. Start it with the sysimage, and point the stage's
+# `daemon` option at the socket:
+#
+#   julia -J pdal_jl_sys.so jl/Daemon.jl /tmp/pdal-julia.sock
+#
+# Each connection is a PDAL stage. The stage copies the columns into a file that both processes map
+# and sends a request naming them (see DaemonClient.cpp for the protocol). The columns are wrapped
+# without copying, so the function changes them in place; columns it returns as new arrays are copied
+# back into the file. A connection sends its script once, and names it by a key after that. Scripts
+# are compiled the first time they're seen and reused after that. The socket is only open to the
+# user running the daemon.
+#
+
+using Sockets
+using Mmap
+using TypedTables
+using PdalJulia
+
+# Element types by their index in the C++ kernel table (JLANG_SCALAR_TYPES)
+const dimTypes = [UInt8, Int8, UInt16, Int16, UInt32, Int32, UInt64, Int64, Float32, Float64]
+
+# User functions by the key the stage gives its script, module and function, which is a hash of them
+const functions = Dict{String, Any}()
+
+function userFunction(key, source, mod, fn)
+  get!(functions, key) do
+    include_string(Main, source)
+    getfield(getfield(Main, Symbol(mod)), Symbol(fn))
+  end
+end
+
+# What's kept between the requests of a connection: the scripts sent on it by key, and the mapped files
+struct Connection
+  scripts::Dict{String, String}
+  mapped::Dict{String, Vector{UInt8}}
+end
+
+Connection() = Connection(Dict{String, String}(), Dict{String, Vector{UInt8}}())
+
+struct Request
+  warm::Bool
+  path::String
+  size::Int
+  points::Int
+  chunks::Int
+  key::String
+  mod::String
+  fn::String
+  dims::Vector{Tuple{Symbol, DataType, Int}}
+end
+
+function readRequest(conn, state::Connection)
+  words = split(readline(conn), ' ')
+  words[1] in ("run", "warm") || error("expected a run or warm request, got '$(join(words, ' '))'")
+  warm = words[1] == "warm"
+  path = String(words[2])
+  size, points, chunks = parse.(Int, words[3:5])
+
+  words = split(readline(conn), ' ')
+  words[1] == "script" || error("expected a script, got '$(words[1])'")
+  key, mod, fn = String(words[2]), String(words[3]), String(words[4])
+  bytes = parse(Int, words[5])
+  bytes > 0 && (state.scripts[key] = String(read(conn, bytes)))
+
+  dims = Tuple{Symbol, DataType, Int}[]
+  while true
+    line = readline(conn)
+    line == "end" && break
+    words = split(line, ' ')
+    push!(dims, (Symbol(words[2]), dimTypes[parse(Int, words[3]) + 1], parse(Int, words[4])))
+  end
+  return Request(warm, path, size, points, chunks, key, mod, fn, dims)
+end
+
+# Values stored in integer columns are rounded, as the C++ stage does
+store!(dst::AbstractVector{T}, src) where {T <: Integer} = dst .= (x -> x isa AbstractFloat ? round(T, x) : T(x)).(src)
+store!(dst::AbstractVector, src) = dst .= src
+
+function handle(conn, req::Request, state::Connection)
+  source = get(state.scripts, req.key, nothing)
+  source === nothing && error("no script was sent with key $(req.key) on this connection")
+  userFn = userFunction(req.key, source, req.mod, req.fn)
+
+  # Compile the function for the table type of the dimensions, without any points
+  if req.warm
+    schema = PdalJulia.Schema([d[1] for d in req.dims], zeros(Int32, length(req.dims)), [d[2] for d in req.dims])
+    Base.invokelatest(PdalJulia.warmUp, schema, userFn)
+    write(conn, "ok\n")
+    return
+  end
+
+  # The stage only grows its file, so a new size means a new mapping
+  buf = get(state.mapped, req.path, nothing)
+  if buf === nothing || length(buf) != req.size
+    buf = open(io -> Mmap.mmap(io, Vector{UInt8}, req.size), req.path, "r+")
+    state.mapped[req.path] = buf
+  end
+
+  names = Tuple(d[1] for d in req.dims)
+  cols = Tuple(unsafe_wrap(Array, Ptr{T}(pointer(buf) + offset), req.points) for (_, T, offset) in req.dims)
+  tbl = Table(NamedTuple{names}(cols))
+
+  chunks = req.chunks == 0 ? Threads.nthreads() : req.chunks
+  ret = GC.@preserve buf Base.invokelatest(PdalJulia.runTable, userFn, tbl, chunks)
+
+  if ret isa Tuple
+    error("a function run by the daemon can't return several tables")
+  elseif ret isa Vector{Int64}
+    write(conn, "keep $(length(ret))\n", ret)
+    return
+  end
+
+  for (col, name) in zip(ret, ret[end])
+    i = findfirst(isequal(name), names)
+    if i === nothing
+      error("the function returned dimension '$name', which wasn't passed to it")
+    elseif col !== cols[i]
+      length(col) == req.points || error("a function run by the daemon can't change the number of points")
+      store!(cols[i], col)
+    end
+  end
+  write(conn, "ok\n")
+end
+
+function serve(conn)
+  state = Connection()
+  while !eof(conn)
+    # The whole request is read before running it, so an error leaves the connection usable
+    req = readRequest(conn, state)
+    try
+      handle(conn, req, state)
+    catch e
+      write(conn, "error " * replace(sprint(showerror, e), '\n' => ' ') * "\n")
+    end
+  end
+end
+
+path = length(ARGS) > 0 ? ARGS[1] : "/tmp/pdal-julia.sock"
+ispath(path) && rm(path)
+server = listen(path)
+chmod(path, 0o600)
+println("PDAL Julia daemon listening on $path with $(Threads.nthreads()) threads")
+
+while true
+  conn = accept(server)
+  @async try
+    serve(conn)
+  catch e
+    e isa Base.IOError || @error "PDAL Julia daemon connection failed" exception = e
+  finally
+    close(conn)
+  end
+end
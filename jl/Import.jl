@@ -6,3 +6,45 @@ using RoamesGeometry
 using AcceleratedArrays
 using StructArrays
 using StaticArrays
+using PdalJulia
+
+# Every element type a PDAL dimension can have
+dimTypes = [UInt8, Int8, UInt16, Int16, UInt32, Int32, UInt64, Int64, Float32, Float64]
+
+# Build the arguments to runStage the way the C++ stage does: one array per dimension, then their
+# schema
+function stageArgs(columns, userFn)
+  names = collect(keys(columns))
+  types = [eltype(c) for c in values(columns)]
+  schema = PdalJulia.Schema(names, zeros(Int32, length(names)), types)
+
+  args = Any[values(columns)...]
+  push!(args, schema, userFn)
+  return args
+end
+
+function runAll(columns)
+  args = stageArgs(columns, identity)
+  PdalJulia.warmUp(args[end - 1], identity)
+  PdalJulia.runStage(args, 1, C_NULL)
+  PdalJulia.runStage(args, 2, C_NULL)
+end
+
+# A single dimension of each type, alone and alongside the coordinates
+for T in dimTypes
+  runAll((; Value = zeros(T, 10)))
+  runAll((; X = zeros(10), Y = zeros(10), Z = zeros(10), Value = zeros(T, 10)))
+end
+
+# The schema of a typical LAS file
+runAll((;
+  X = zeros(10), Y = zeros(10), Z = zeros(10),
+  Intensity = zeros(UInt16, 10),
+  ReturnNumber = zeros(UInt8, 10), NumberOfReturns = zeros(UInt8, 10),
+  Classification = zeros(UInt8, 10),
+  GpsTime = zeros(10),
+  Red = zeros(UInt16, 10), Green = zeros(UInt16, 10), Blue = zeros(UInt16, 10)
+))
+
+# The radial density kernel over coordinate columns
+PdalJulia.radialDensity!(zeros(10), rand(10), rand(10), rand(10), 1.0)
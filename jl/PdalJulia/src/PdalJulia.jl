@@ -0,0 +1,462 @@
+module PdalJulia
+
+  using TypedTables
+
+  export runTable, radius, knn, radius!, knn!, radialDensity!
+
+  #
+  # The dimensions passed to runStage, built once by the C++ stage when it's ready and reused for every
+  # view and batch. `ids` are the PDAL Dimension::Id of each, and `tableType` the NamedTuple type of the
+  # table of them, so every view gets a table of the same concrete type.
+  #
+  struct Schema{N}
+    names::NTuple{N, Symbol}
+    ids::NTuple{N, Int32}
+    tableType::DataType
+  end
+
+  function Schema(names::AbstractVector{Symbol}, ids::AbstractVector{<:Integer}, types::AbstractVector)
+    N = length(names)
+    tableType = NamedTuple{Tuple(names), Tuple{(Vector{T} for T in types)...}}
+    return Schema{N}(Tuple(names), NTuple{N, Int32}(ids), tableType)
+  end
+
+  #
+  # The points of the view the function is called for, which a function taking a second argument is
+  # passed. `radius` and `knn` query PDAL's KD index of them, built for the call on the first query,
+  # through callbacks into the C++ stage. It is only valid while the function runs, and unavailable
+  # when streaming, running a view in windows or in a daemon. The indices returned are of the rows of
+  # the whole view, even in a chunk of it.
+  #
+  struct PointView
+    handle::Ptr{Cvoid}
+  end
+
+  const radiusFn = Ref{Ptr{Cvoid}}(C_NULL)
+  const knnFn = Ref{Ptr{Cvoid}}(C_NULL)
+  const errorFn = Ref{Ptr{Cvoid}}(C_NULL)
+
+  # Set by the C++ stage when it loads the runtime
+  function setIndexFunctions(radius::Ptr{Cvoid}, knn::Ptr{Cvoid}, lastError::Ptr{Cvoid})
+    radiusFn[] = radius
+    knnFn[] = knn
+    errorFn[] = lastError
+    return nothing
+  end
+
+  # Why the last query of the view's index failed
+  function indexError(view::PointView)
+    msg = Vector{UInt8}(undef, 1024)
+    len = GC.@preserve msg ccall(errorFn[], Csize_t, (Ptr{Cvoid}, Ptr{UInt8}, Csize_t), view.handle,
+      pointer(msg), length(msg))
+    return String(msg[1:min(len, length(msg))])
+  end
+
+  function checkIndex(view::PointView)
+    if view.handle == C_NULL || radiusFn[] == C_NULL
+      error("filters.julia: there's no point index when streaming, running a view in windows or in a daemon")
+    end
+  end
+
+  # Coordinates of points to query, as X and Y columns, and a Z column for the 3D index. Table
+  # columns and chunks of them are contiguous, so are passed to C++ as they are.
+  function queryDims(x, y, z)
+    length(x) == length(y) && (z === nothing || length(z) == length(x)) ||
+      throw(DimensionMismatch("coordinate columns differ in length"))
+    all(c -> c === nothing || stride(c, 1) == 1, (x, y, z)) ||
+      throw(ArgumentError("coordinate columns must be contiguous"))
+    return z === nothing ? 2 : 3
+  end
+
+  #
+  # Find the points within `r` of each point of `x`, `y` and `z`, setting `counts` to the number
+  # found for each and `ids` to their indices, one point's after another. `ids` is resized to fit,
+  # which only allocates when it grows. With `ids` of `nothing`, only the counts are found. Leave
+  # out `z` to query in 2D. Returns `ids`.
+  #
+  function radius!(counts::DenseVector{Int64}, ids::Union{Vector{Int64}, Nothing}, view::PointView,
+      r::Real, x::StridedVector{Float64}, y::StridedVector{Float64},
+      z::Union{StridedVector{Float64}, Nothing} = nothing)
+    checkIndex(view)
+    dims = queryDims(x, y, z)
+    n = length(x)
+    length(counts) == n || throw(DimensionMismatch("counts has $(length(counts)) elements for $n points"))
+
+    query(ids, capacity) = GC.@preserve counts ids x y z ccall(radiusFn[], Csize_t,
+      (Ptr{Cvoid}, Csize_t, Ptr{Float64}, Ptr{Float64}, Ptr{Float64}, Csize_t, Float64, Ptr{Int64}, Ptr{Int64}, Csize_t),
+      view.handle, dims, pointer(x), pointer(y), z === nothing ? C_NULL : pointer(z), n, r,
+      pointer(counts), ids === nothing ? C_NULL : pointer(ids), capacity)
+
+    total = query(ids, ids === nothing ? 0 : length(ids))
+    total == typemax(Csize_t) && error("filters.julia: radius query failed: $(indexError(view))")
+    if ids !== nothing
+      if total > length(ids)
+        resize!(ids, total)
+        query(ids, total)
+      else
+        resize!(ids, total)
+      end
+    end
+    return ids
+  end
+
+  #
+  # Set each column of `ids` to the indices of the nearest `size(ids, 1)` points to a point of `x`, `y`
+  # and `z`, padded with 0 when the view has fewer. Leave out `z` to query in 2D. Returns `ids`.
+  #
+  function knn!(ids::DenseMatrix{Int64}, view::PointView, x::StridedVector{Float64},
+      y::StridedVector{Float64}, z::Union{StridedVector{Float64}, Nothing} = nothing)
+    checkIndex(view)
+    dims = queryDims(x, y, z)
+    n = length(x)
+    size(ids, 2) == n || throw(DimensionMismatch("ids has $(size(ids, 2)) columns for $n points"))
+
+    found = GC.@preserve ids x y z ccall(knnFn[], Csize_t,
+      (Ptr{Cvoid}, Csize_t, Ptr{Float64}, Ptr{Float64}, Ptr{Float64}, Csize_t, Csize_t, Ptr{Int64}),
+      view.handle, dims, pointer(x), pointer(y), z === nothing ? C_NULL : pointer(z), n, size(ids, 1),
+      pointer(ids))
+    found == typemax(Csize_t) && error("filters.julia: knn query failed: $(indexError(view))")
+    return ids
+  end
+
+  # The indices of the points within `r` of a point of 2 or 3 coordinates
+  function radius(view::PointView, point, r::Real)
+    c = coords(point)
+    return radius!([0], Vector{Int64}(undef, 64), view, r, c...)
+  end
+
+  # The indices of the `k` points nearest a point of 2 or 3 coordinates, nearest first
+  function knn(view::PointView, point, k::Integer)
+    ids = knn!(zeros(Int64, k, 1), view, coords(point)...)
+    return filter(!iszero, vec(ids))
+  end
+
+  function coords(point)
+    length(point) in (2, 3) || throw(ArgumentError("a point has 2 or 3 coordinates"))
+    return map(c -> Float64[c], Tuple(point))
+  end
+
+  #
+  # Set `density` to the radial density of every point, as filters.radialdensity computes it: the
+  # number of points within `r` of it, itself included, over the volume of a sphere of radius `r`.
+  # The points are bucketed in a grid of cells `r` wide, so only the 27 cells around a point are
+  # searched, and they're searched across Julia's threads without allocating. The grid takes about
+  # 40 bytes a point. Every point of the columns is searched, so don't run it with `chunks`.
+  #
+  function radialDensity!(density::AbstractVector{<:AbstractFloat}, x::AbstractVector{<:Real},
+      y::AbstractVector{<:Real}, z::AbstractVector{<:Real}, r::Real)
+    n = length(x)
+    length(y) == n && length(z) == n && length(density) == n ||
+      throw(DimensionMismatch("columns differ in length"))
+    r > 0 || throw(ArgumentError("radius must be positive"))
+    n == 0 && return density
+
+    grid = DensityGrid(x, y, z, Float64(r))
+
+    # filters.radialdensity's own value of pi, so the densities match
+    factor = 1.0 / ((4.0 / 3.0) * 3.14159 * Float64(r)^3)
+    Threads.@threads for i = 1:n
+      @inbounds density[i] = factor * neighbourCount(grid, Float64(x[i]), Float64(y[i]), Float64(z[i]))
+    end
+    return density
+  end
+
+  #
+  # Points sorted into buckets by the cell of the grid they're in. Cells are keyed by their position
+  # on each axis modulo 2^21, and a bucket holds the cells with a hash of their key, so a search
+  # checks the key of every point in a bucket. Keys only repeat for cells 2^21 apart, which no
+  # search spans, and points of those are told apart by their distance anyway.
+  #
+  struct DensityGrid
+    origin::NTuple{3, Float64}
+    scale::Float64                # 1 / the width of a cell
+    r2::Float64
+    shift::Int                    # 64 - log2 of the number of buckets
+    start::Vector{Int}            # Bucket b is start[b + 1] + 1 : start[b + 2] of those below
+    keys::Vector{Int64}
+    xs::Vector{Float64}
+    ys::Vector{Float64}
+    zs::Vector{Float64}
+  end
+
+  const cellMask = (1 << 21) - 1
+
+  @inline cellOf(v, origin, scale) = unsafe_trunc(Int, (v - origin) * scale)
+  @inline cellKey(cx, cy, cz) = (cx & cellMask) | ((cy & cellMask) << 21) | ((cz & cellMask) << 42)
+  @inline bucketOf(grid, key) = Int((UInt64(key) * 0x9e3779b97f4a7c15) >> grid.shift)
+
+  # Counting sort of the points by bucket, with about one bucket for every two points. Cells are a
+  # little wider than `r`, so rounding can't put points within `r` of each other two cells apart.
+  function DensityGrid(x, y, z, r::Float64)
+    n = length(x)
+    origin = (Float64(minimum(x)), Float64(minimum(y)), Float64(minimum(z)))
+    largest = maximum(abs, (origin..., Float64(maximum(x)), Float64(maximum(y)), Float64(maximum(z))))
+    scale = 1.0 / (r * (1 + 1e-9) + 16 * eps(largest))
+    buckets = nextpow(2, max(1, n >> 1))
+    grid = DensityGrid(origin, scale, r * r, 64 - trailing_zeros(buckets), zeros(Int, buckets + 1),
+      Vector{Int64}(undef, n), Vector{Float64}(undef, n), Vector{Float64}(undef, n), Vector{Float64}(undef, n))
+
+    key(i) = @inbounds cellKey(cellOf(x[i], origin[1], scale), cellOf(y[i], origin[2], scale),
+      cellOf(z[i], origin[3], scale))
+
+    start = grid.start
+    @inbounds for i = 1:n
+      start[bucketOf(grid, key(i)) + 1] += 1
+    end
+    @inbounds for b = 2:buckets
+      start[b] += start[b - 1]
+    end
+    start[buckets + 1] = n
+
+    # Filled from the end of each bucket, which leaves start[b + 1] one before the bucket
+    @inbounds for i = n:-1:1
+      k = key(i)
+      b = bucketOf(grid, k) + 1
+      j = start[b]
+      start[b] = j - 1
+      grid.keys[j] = k
+      grid.xs[j] = x[i]
+      grid.ys[j] = y[i]
+      grid.zs[j] = z[i]
+    end
+    return grid
+  end
+
+  # The number of points within the radius of a point, searching the cells around its own
+  function neighbourCount(grid::DensityGrid, px::Float64, py::Float64, pz::Float64)
+    cx = cellOf(px, grid.origin[1], grid.scale)
+    cy = cellOf(py, grid.origin[2], grid.scale)
+    cz = cellOf(pz, grid.origin[3], grid.scale)
+    count = 0
+    @inbounds for dz = -1:1, dy = -1:1, dx = -1:1
+      k = cellKey(cx + dx, cy + dy, cz + dz)
+      b = bucketOf(grid, k)
+      for j = grid.start[b + 1] + 1 : grid.start[b + 2]
+        if grid.keys[j] == k
+          ex = grid.xs[j] - px
+          ey = grid.ys[j] - py
+          ez = grid.zs[j] - pz
+          count += (ex * ex + ey * ey + ez * ez < grid.r2)
+        end
+      end
+    end
+    return count
+  end
+
+  #
+  # The main runtime for interfacing between the PDAL C++ Stage and the user-supplied Julia fn.
+  #
+  # This function is passed an array of arguments,
+  #
+  # 1..N-2 => Array for each dimension in the PointCloud
+  # N-1    => The Schema of those dimensions
+  # N      => The user-defined function. It should be of the type: (Table -> Table)
+  #
+  # The execution of the stage consists of converting the input argument into a Table with concrete column types,
+  # running the user-supplied function with the TypedTable as its only argument, and finally unpacking the
+  # TypedTable returned into a format readable by C++
+  #
+  # With `chunks` > 1 the table is split into that many row-chunks, which the function is run on
+  # concurrently. 0 uses a chunk per Julia thread. `index` is the C++ stage's handle for queries of the
+  # view's points, passed to the function as a PointView.
+  function runStage(args, chunks::Integer = 1, index::Ptr{Cvoid} = C_NULL)
+    schema = args[length(args) - 1]::Schema
+    userFn = args[length(args)]
+
+    # Convert to a concretely typed Table
+    cols = ntuple(i -> args[i], length(schema.names))
+    tbl = Table(schema.tableType(cols))
+
+    if chunks == 0
+      chunks = Threads.nthreads()
+    end
+    return runTable(userFn, tbl, chunks, PointView(index))
+  end
+
+  # Function barrier between the untyped arguments from C++ and the user function, which is
+  # specialised on the concrete type of the table. User code can call it too, to run a function
+  # on a table it has built.
+  function runTable(userFn, tbl::Table, chunks::Integer = 1, view::PointView = PointView(C_NULL))
+    # Run the user-supplied function on the input data
+    if chunks > 1 && length(tbl) >= chunks
+      ret = runChunked(userFn, tbl, chunks, view)
+    else
+      ret = callUser(userFn, tbl, view)
+    end
+
+    # Convert the TypedTable back into a format that is readable from C++. A list of tables or
+    # selections is passed back as a tuple of them, and each becomes a separate view.
+    if isSplit(ret)
+      return Tuple(unwrapRet(part) for part in ret)
+    end
+    return unwrapRet(ret)
+  end
+
+  # Tables are vectors of rows, so a list is told apart by its element type
+  isSplit(ret) = ret isa AbstractVector &&
+    (eltype(ret) <: AbstractVector || (eltype(ret) == Any && !isempty(ret) && all(p -> p isa AbstractVector, ret)))
+
+  # Run the user function on `chunks` row-chunks of the table with a task each, and concatenate the
+  # outputs. The chunks are views of the input columns, so a column the function changed in place
+  # comes back as the input array rather than a copy.
+  function runChunked(userFn, tbl, chunks, pointView = PointView(C_NULL))
+    len = length(tbl)
+    inputs = TypedTables.columns(tbl)
+    ranges = [div(len * (i - 1), chunks) + 1 : div(len * i, chunks) for i = 1:chunks]
+
+    tasks = map(ranges) do r
+      chunk = Table(map(col -> view(col, r), inputs))
+      Threads.@spawn callUser(userFn, chunk, pointView)
+    end
+    parts = fetch.(tasks)
+    if any(isSplit, parts)
+      error("filters.julia: a function returning several tables can't be run in chunks")
+    end
+
+    # Selections of each chunk combine into one of the whole table
+    if all(p -> p isa AbstractVector{Bool}, parts)
+      return vcat(parts...)
+    elseif all(p -> p isa AbstractVector{<:Integer}, parts)
+      return vcat((parts[i] .+ (first(ranges[i]) - 1) for i = 1:chunks)...)
+    end
+
+    names = TypedTables.columnnames(parts[1])
+    if any(p -> TypedTables.columnnames(p) != names, parts)
+      error("filters.julia: chunks returned different dimensions")
+    end
+
+    cols = map(names) do name
+      if haskey(inputs, name) && all(i -> isChunkOf(getproperty(parts[i], name), inputs[name], ranges[i]), 1:chunks)
+        inputs[name]
+      else
+        vcat((getproperty(p, name) for p in parts)...)
+      end
+    end
+    return Table(NamedTuple{names}(cols))
+  end
+
+  # Functions taking a second argument are passed the view, to query its points
+  callUser(userFn, tbl, view::PointView) = applicable(userFn, tbl, view) ? userFn(tbl, view) : userFn(tbl)
+
+  isChunkOf(col, input, r) = col isa SubArray && parent(col) === input && parentindices(col) == (r,)
+
+  # Compile runStage, runTable and the user function for the table type of a schema without running
+  # them, so the first view doesn't pay for it. A function that can't be compiled ahead of time is
+  # left to compile on its first call, so this only returns whether it worked.
+  function warmUp(schema::Schema, userFn)
+    try
+      cols = ntuple(i -> fieldtype(schema.tableType, i)(), length(schema.names))
+      tblType = typeof(Table(schema.tableType(cols)))
+      return precompile(runStage, (Vector{Any}, Int, Ptr{Cvoid})) &
+        precompile(runTable, (typeof(userFn), tblType, Int, PointView)) &
+        (hasmethod(userFn, Tuple{tblType, PointView}) ?
+          precompile(userFn, (tblType, PointView)) : precompile(userFn, (tblType,)))
+    catch
+      return false
+    end
+  end
+
+  #
+  # Load a user script as a package precompiled into `cacheDir`, compiling it there the first time.
+  # The package is named by a hash of the script, the schema and the sysimage, so changing any of
+  # them compiles a new one, and it precompiles the function for the schema's table type. Packages
+  # are compiled by a separate Julia process, found at ENV["JULIA_PATH"] or beside this one. Returns
+  # the user function, or `nothing` if the cache can't be used.
+  #
+  function loadCached(cacheDir::AbstractString, source::AbstractString, mod::AbstractString,
+      fn::AbstractString, schema::Schema)
+    cacheDir = abspath(cacheDir)
+    image = unsafe_string(Base.JLOptions().image_file)
+    types = [string(eltype(fieldtype(schema.tableType, i))) for i = 1:length(schema.names)]
+    key = hash((String(source), String(mod), String(fn), string.(schema.names), types,
+      string(VERSION), image, string(mtime(image))))
+    name = "PdalScript_" * string(key, base = 16)
+    id = Base.PkgId(name)
+
+    pushfirst!(LOAD_PATH, cacheDir)
+    pushfirst!(DEPOT_PATH, cacheDir)
+    try
+      if !Base.root_module_exists(id)
+        writeCachedPackage(cacheDir, name, source, mod, fn, schema, types)
+        if isempty(Base.find_all_in_cache_path(id))
+          julia = juliaExecutable()
+          paths = "pushfirst!(LOAD_PATH, $(repr(cacheDir))); pushfirst!(DEPOT_PATH, $(repr(cacheDir)))"
+          run(`$julia -J $image --startup-file=no -e "$paths; Base.compilecache(Base.PkgId($(repr(name))))"`)
+        end
+      end
+      return getfield(Base.require(Main, Symbol(name)), :userFn)
+    catch e
+      @warn "filters.julia: can't use the compiled script cache in $cacheDir" exception = e
+      return nothing
+    finally
+      deleteat!(LOAD_PATH, findfirst(isequal(cacheDir), LOAD_PATH))
+      deleteat!(DEPOT_PATH, findfirst(isequal(cacheDir), DEPOT_PATH))
+    end
+  end
+
+  # The Julia that compiles packages. JULIA_PATH may name the executable, or the directory Julia is
+  # installed in, as in the Docker image.
+  function juliaExecutable()
+    path = get(ENV, "JULIA_PATH", "")
+    isempty(path) && return joinpath(Sys.BINDIR, Base.julia_exename())
+    return isdir(path) ? joinpath(path, "bin", Base.julia_exename()) : path
+  end
+
+  # The package for a script: the script itself, its function, and a precompile of the function
+  # for the schema. Written to a temporary file and moved, as other processes may share the cache.
+  function writeCachedPackage(cacheDir, name, source, mod, fn, schema, types)
+    dir = joinpath(cacheDir, name, "src")
+    file = joinpath(dir, name * ".jl")
+    isfile(file) && return
+    mkpath(dir)
+    write(joinpath(dir, "script.jl"), source)
+    tmp, io = mktemp(dir)
+    write(io, """
+      module $name
+        using PdalJulia
+        include("script.jl")
+        const userFn = $mod.$fn
+        PdalJulia.warmUp(PdalJulia.Schema($(repr(collect(schema.names))), zeros(Int32, $(length(types))),
+          [$(join(types, ", "))]), userFn)
+      end
+      """)
+    close(io)
+    mv(tmp, file, force = true)
+  end
+
+  # Run runStage as a task on Julia's thread pool, so the C++ stage can start one per view and
+  # fetch the results in order. Tasks only run in parallel when Julia was started with threads.
+  spawnStage(args, chunks::Integer = 1, index::Ptr{Cvoid} = C_NULL) =
+    Threads.@spawn runStage(args, chunks, index)
+
+  # Convert TypedTable into an array of arrays such that the final array is a list of dimension
+  # names (as Symbols) corresponding to the preceding arrays. A mask or a vector of indices instead selects the
+  # points to keep, and is passed back as the (1-based) indices of those points.
+  function unwrapRet(ret)
+    if ret isa AbstractVector{Bool}
+      return Vector{Int64}(findall(ret))
+    elseif ret isa AbstractVector{<:Integer}
+      return Vector{Int64}(ret)
+    elseif !(ret isa AbstractVector && eltype(ret) <: NamedTuple)
+      error("filters.julia: function returned a $(typeof(ret)), not a table, a mask or indices of points")
+    end
+
+    result = []
+    dims = []
+    for colname in TypedTables.columnnames(ret)
+      col = Base.getproperty(ret, colname)
+
+      # Ranges, views and BitVectors don't have the memory layout C++ reads,
+      # and PDAL has no Bool type, so flags are passed as bytes
+      push!(dims, colname)
+      push!(result, eltype(col) == Bool ? Vector{UInt8}(col) :
+        col isa Vector ? col : collect(col))
+    end
+
+    # Add the dim names in order as the last element in the result array passed back to C++
+    push!(result, dims)
+
+    return result
+  end
+
+end # module
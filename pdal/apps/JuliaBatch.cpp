@@ -0,0 +1,233 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+// Runs a pipeline over many files in one process, so that Julia is started
+// and the filters.julia script compiled once for the whole batch rather
+// than once per file:
+//
+//   pdal_julia_batch [--workers N] [--threads N] template.json files...
+//
+// The template is a pipeline in which "{input}" is replaced by the path of
+// each file and "{stem}" by its name without the extension. Files may be
+// given as globs. Each worker thread runs a file's pipeline at a time;
+// reading, writing and marshalling run concurrently, while calls into
+// Julia are made on the main thread, the only one Julia allows.
+
+#include "../filters/JuliaFilter.hpp"
+#include "../jlang/Environment.hpp"
+#include "../jlang/Stopwatch.hpp"
+
+#include <pdal/PipelineManager.hpp>
+#include <pdal/util/FileUtils.hpp>
+#include <pdal/util/Utils.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+using namespace pdal;
+
+namespace
+{
+
+struct BatchOptions
+{
+    std::string m_template;
+    StringList m_files;
+    int m_workers = (std::max)(1u, std::thread::hardware_concurrency());
+    int m_threads = 0;
+};
+
+void usage()
+{
+    std::cerr << "usage: pdal_julia_batch [--workers N] [--threads N] "
+        "template.json files...\n"
+        "  --workers N   Files processed at once (default: one per core)\n"
+        "  --threads N   Threads Julia is started with (default: "
+        "JULIA_NUM_THREADS)\n"
+        "In the template, {input} is replaced by each file's path and "
+        "{stem} by its\nname without the extension.\n";
+}
+
+bool parse(int argc, char *argv[], BatchOptions& opts)
+{
+    StringList positional;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if ((arg == "--workers" || arg == "--threads") && i + 1 < argc)
+        {
+            int n;
+            if (!Utils::fromString(argv[++i], n) || n < 0)
+                return false;
+            (arg == "--workers" ? opts.m_workers : opts.m_threads) = n;
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+            return false;
+        else
+            positional.push_back(arg);
+    }
+    if (positional.size() < 2 || opts.m_workers < 1)
+        return false;
+
+    opts.m_template = FileUtils::readFileIntoString(positional[0]);
+    if (opts.m_template.empty())
+    {
+        std::cerr << "pdal_julia_batch: can't read pipeline template '" <<
+            positional[0] << "'.\n";
+        return false;
+    }
+    for (auto it = positional.begin() + 1; it != positional.end(); ++it)
+    {
+        StringList matches = FileUtils::glob(*it);
+        if (matches.empty())
+            std::cerr << "pdal_julia_batch: no files match '" << *it <<
+                "'.\n";
+        opts.m_files.insert(opts.m_files.end(), matches.begin(),
+            matches.end());
+    }
+    return true;
+}
+
+// Escape a value substituted into a JSON string
+std::string escape(const std::string& s)
+{
+    std::string out;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+std::string substitute(std::string text, const std::string& name,
+    const std::string& value)
+{
+    for (std::size_t pos = text.find(name); pos != std::string::npos;
+            pos = text.find(name, pos + value.size()))
+        text.replace(pos, name.size(), value);
+    return text;
+}
+
+point_count_t runFile(const std::string& pipeline)
+{
+    std::istringstream in(pipeline);
+    PipelineManager mgr;
+    mgr.readPipeline(in);
+    return mgr.execute();
+}
+
+} // unnamed namespace
+
+
+int main(int argc, char *argv[])
+{
+    BatchOptions opts;
+    if (!parse(argc, argv, opts))
+    {
+        usage();
+        return 1;
+    }
+
+    // The pipelines' filters.julia stages come from the plugin linked in,
+    // so they share this program's Julia environment.
+    JuliaFilter::registerLinked();
+
+    // Start Julia up front on this thread. The handle keeps the runtime,
+    // and the scripts it has compiled, for the whole batch.
+    jlang::Stopwatch sw;
+    jlang::EnvironmentPtr env = jlang::Environment::get(opts.m_threads);
+    std::cerr << "Julia started in " << sw.elapsed().m_wall << "s\n";
+
+    std::mutex outputMutex;
+    std::atomic<std::size_t> next(0);
+    std::atomic<std::size_t> failed(0);
+    auto worker = [&]()
+    {
+        for (std::size_t i = next++; i < opts.m_files.size(); i = next++)
+        {
+            const std::string& file = opts.m_files[i];
+            std::string pipeline = substitute(opts.m_template, "{input}",
+                escape(file));
+            pipeline = substitute(pipeline, "{stem}",
+                escape(FileUtils::stem(FileUtils::getFilename(file))));
+
+            jlang::Stopwatch fileTime;
+            std::string result;
+            try
+            {
+                point_count_t count = runFile(pipeline);
+                result = std::to_string(count) + " points in " +
+                    std::to_string(fileTime.elapsed().m_wall) + "s";
+            }
+            catch (const std::exception& err)
+            {
+                result = std::string("failed: ") + err.what();
+                ++failed;
+            }
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cout << file << ": " << result << std::endl;
+        }
+    };
+
+    sw.restart();
+    try
+    {
+        jlang::Environment::serve([&]()
+        {
+            std::vector<std::thread> workers;
+            for (int i = 0; i < opts.m_workers; ++i)
+                workers.emplace_back(worker);
+            for (std::thread& t : workers)
+                t.join();
+        });
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "pdal_julia_batch: " << err.what() << std::endl;
+        return 1;
+    }
+
+    std::cerr << opts.m_files.size() << " files in " <<
+        sw.elapsed().m_wall << "s";
+    if (failed)
+        std::cerr << ", " << failed << " failed";
+    std::cerr << std::endl;
+    return failed ? 1 : 0;
+}
@@ -124,7 +124,7 @@ macro(PDAL_JULIA_ADD_TEST _name)
     endif()
     target_link_libraries(${_name}
         PRIVATE
-          ${PDAL_JULIA_ADD_PLUGIN_LINK_WITH}
+          ${PDAL_JULIA_ADD_TEST_LINK_WITH}
           gtest
           ${WINSOCK_LIBRARY}
     )
@@ -135,3 +135,52 @@ macro(PDAL_JULIA_ADD_TEST _name)
         "${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/..")
 endmacro(PDAL_JULIA_ADD_TEST)
 
+macro(PDAL_JULIA_ADD_BENCHMARK _name)
+    set(options)
+    set(oneValueArgs)
+    set(multiValueArgs FILES LINK_WITH INCLUDES SYSTEM_INCLUDES)
+    cmake_parse_arguments(PDAL_JULIA_ADD_BENCHMARK "${options}" "${oneValueArgs}"
+        "${multiValueArgs}" ${ARGN})
+
+    add_executable(${_name} ${PDAL_JULIA_ADD_BENCHMARK_FILES})
+    pdal_julia_target_compile_settings(${_name})
+    target_include_directories(${_name} PRIVATE
+        ${PROJECT_BINARY_DIR}/include
+        ${PDAL_INCLUDE_DIR}
+        ${PDAL_JULIA_ADD_BENCHMARK_INCLUDES}
+    )
+    if (PDAL_JULIA_ADD_BENCHMARK_SYSTEM_INCLUDES)
+        target_include_directories(${_name} SYSTEM PRIVATE
+          ${PDAL_JULIA_ADD_BENCHMARK_SYSTEM_INCLUDES})
+    endif()
+    target_link_libraries(${_name}
+        PRIVATE
+          ${PDAL_JULIA_ADD_BENCHMARK_LINK_WITH}
+          benchmark
+    )
+    # Benchmarks are run by hand, not as part of ctest
+endmacro(PDAL_JULIA_ADD_BENCHMARK)
+
+macro(PDAL_JULIA_ADD_APP _name)
+    set(options)
+    set(oneValueArgs)
+    set(multiValueArgs FILES LINK_WITH INCLUDES SYSTEM_INCLUDES)
+    cmake_parse_arguments(PDAL_JULIA_ADD_APP "${options}" "${oneValueArgs}"
+        "${multiValueArgs}" ${ARGN})
+
+    add_executable(${_name} ${PDAL_JULIA_ADD_APP_FILES})
+    pdal_julia_target_compile_settings(${_name})
+    target_include_directories(${_name} PRIVATE
+        ${PROJECT_BINARY_DIR}/include
+        ${PDAL_INCLUDE_DIR}
+        ${PDAL_JULIA_ADD_APP_INCLUDES}
+    )
+    if (PDAL_JULIA_ADD_APP_SYSTEM_INCLUDES)
+        target_include_directories(${_name} SYSTEM PRIVATE
+          ${PDAL_JULIA_ADD_APP_SYSTEM_INCLUDES})
+    endif()
+    target_link_libraries(${_name}
+        PRIVATE
+          ${PDAL_JULIA_ADD_APP_LINK_WITH}
+    )
+endmacro(PDAL_JULIA_ADD_APP)
@@ -36,11 +36,15 @@
 
 #include "../nlohmann/json.hpp"
 
+#include <pdal/PluginManager.hpp>
 #include <pdal/PointView.hpp>
 #include <pdal/DimUtil.hpp>
+#include <pdal/util/Algorithm.hpp>
 #include <pdal/util/ProgramArgs.hpp>
 #include <pdal/util/FileUtils.hpp>
 
+#include <map>
+
 // #include <julia.h>
 // JULIA_DEFINE_FAST_TLS() // only define this once, in an executable (not in a shared library) if you want fast code.
 
@@ -56,6 +60,14 @@ static PluginInfo const s_info
 
 CREATE_SHARED_STAGE(JuliaFilter, s_info)
 
+// Programs that link the plugin register the stage from their own copy, so
+// that PDAL creates it from there rather than loading another copy from
+// PDAL_DRIVER_PATH, which would have a Julia environment of its own.
+void JuliaFilter::registerLinked()
+{
+    PluginManager<Stage>::registerPlugin<JuliaFilter>(s_info);
+}
+
 struct JuliaFilter::Args
 {
     std::string m_module;
@@ -63,11 +75,26 @@ struct JuliaFilter::Args
     std::string m_source;
     std::string m_scriptFile;
     StringList m_addDimensions;
+    point_count_t m_batchSize;
+    bool m_parallel;
+    int m_chunks;
+    int m_threads;
+    std::string m_groupBy;
+    std::string m_daemon;
+    std::string m_cacheDir;
+    point_count_t m_chunkSize;
+    uint64_t m_memoryLimit;
+    StringList m_readDims;
+    StringList m_writeDims;
+    std::string m_dirtyCheck;
     NL::json m_pdalargs;
 };
 
 JuliaFilter::JuliaFilter() :
-    m_script(nullptr), m_juliaMethod(nullptr), m_args(new Args)
+    m_script(nullptr), m_juliaMethod(nullptr),
+    m_groupDim(Dimension::Id::Unknown), m_streamTable(nullptr),
+    m_inBatch(false),
+    m_args(new Args)
 {}
 
 
@@ -90,6 +117,34 @@ void JuliaFilter::addArgs(ProgramArgs& args)
     args.add("source", "Julia script to run", m_args->m_source);
     args.add("script", "File containing script to run", m_args->m_scriptFile);
     args.add("add_dimension", "Dimensions to add", m_args->m_addDimensions);
+    args.add("read_dims", "Dimensions to pass to the function, or 'auto' "
+        "to pass the ones named in the script, or all of them if it may look "
+        "columns up dynamically (default: all)", m_args->m_readDims);
+    args.add("write_dims", "Dimensions to write back from the function "
+        "(default: all modified)", m_args->m_writeDims);
+    args.add("dirty_check", "How to detect unmodified dimensions: "
+        "'checksum', 'identity' or 'none'", m_args->m_dirtyCheck, "checksum");
+    args.add("batch_size", "Maximum number of points passed to the function "
+        "at once when streaming (default: all points held by the stream)",
+        m_args->m_batchSize, point_count_t(0));
+    args.add("parallel", "Run the function over each view as a task on "
+        "Julia's thread pool", m_args->m_parallel);
+    args.add("chunks", "Number of row-chunks to split each call into, run "
+        "on Julia's threads. 0 uses one per thread", m_args->m_chunks, 1);
+    args.add("threads", "Number of threads to start Julia with (default: "
+        "JULIA_NUM_THREADS)", m_args->m_threads, 0);
+    args.add("group_by", "Dimension to split the points returned by",
+        m_args->m_groupBy);
+    args.add("daemon", "Socket of a Julia daemon (jl/Daemon.jl) to run the "
+        "function in, instead of in this process", m_args->m_daemon);
+    args.add("chunk_size", "Maximum number of points of a view passed to "
+        "the function at once, in windows run in turn (default: all)",
+        m_args->m_chunkSize, point_count_t(0));
+    args.add("memory_limit", "Approximate limit in bytes on the columns "
+        "copied for a view, which sets the window size (default: none)",
+        m_args->m_memoryLimit, uint64_t(0));
+    args.add("cache_dir", "Directory to keep compiled scripts in between "
+        "runs (default: PDAL_JULIA_CACHE_DIR)", m_args->m_cacheDir);
     args.add("pdalargs", "Dictionary to add to module globals when "
         "calling function", m_args->m_pdalargs);
 }
@@ -125,6 +180,23 @@ void JuliaFilter::prepared(PointTableRef table)
         throwError("Can't set both 'source' and 'script' options.");
     if (!m_args->m_source.size() && !m_args->m_scriptFile.size())
         throwError("Must set one of 'source' and 'script' options.");
+    if (m_args->m_dirtyCheck != "checksum" &&
+            m_args->m_dirtyCheck != "identity" &&
+            m_args->m_dirtyCheck != "none")
+        throwError("Invalid 'dirty_check' value '" + m_args->m_dirtyCheck +
+            "'.  Must be 'checksum', 'identity' or 'none'.");
+    if (m_args->m_parallel && m_args->m_groupBy.size())
+        throwError("Can't set both 'parallel' and 'group_by' options.");
+    if (m_args->m_chunks < 0)
+        throwError("Option 'chunks' must not be negative.");
+    if (m_args->m_threads < 0)
+        throwError("Option 'threads' must not be negative.");
+    if (m_args->m_daemon.size() && m_args->m_parallel)
+        throwError("Can't set both 'daemon' and 'parallel' options.");
+    if ((m_args->m_chunkSize || m_args->m_memoryLimit) &&
+            (m_args->m_parallel || m_args->m_daemon.size()))
+        throwError("Options 'chunk_size' and 'memory_limit' can't be used "
+            "with 'parallel' or 'daemon'.");
 }
 
 
@@ -137,27 +209,244 @@ void JuliaFilter::ready(PointTableRef table)
     // env->set_stdout(out);
     m_script.reset(new jlang::Script(m_args->m_source, m_args->m_module,
         m_args->m_function));
+    m_pending.clear();
+    m_outputs.clear();
+    m_streamTable = dynamic_cast<StreamPointTable *>(&table);
+    m_inBatch = false;
+    if (m_args->m_groupBy.size())
+    {
+        m_groupDim = table.layout()->findDim(m_args->m_groupBy);
+        if (m_groupDim == Dimension::Id::Unknown)
+            throwError("Invalid dimension '" + m_args->m_groupBy +
+                "' in 'group_by'.");
+    }
+
+    // The daemon has its own Julia, so this process never starts one
+    if (m_args->m_daemon.size())
+    {
+        m_daemon.reset(new jlang::DaemonClient(m_args->m_daemon, *m_script));
+        m_daemon->setChunks(m_args->m_chunks);
+        m_daemon->setReadDims(readDims(table.layout()));
+        m_daemon->setWriteDims(writeDims(table.layout()));
+        m_daemon->warmUp(table.layout());
+        return;
+    }
+
     m_juliaMethod.reset(new jlang::Invocation(*m_script, table.metadata(),
-        m_args->m_pdalargs.dump(1)));
+        m_args->m_pdalargs.dump(1), m_args->m_threads));
+    m_juliaMethod->setChunks(m_args->m_chunks);
+    m_juliaMethod->setWindowSize(m_args->m_chunkSize);
+    m_juliaMethod->setMemoryLimit(m_args->m_memoryLimit);
+    if (m_args->m_cacheDir.empty())
+        Utils::getenv("PDAL_JULIA_CACHE_DIR", m_args->m_cacheDir);
+    m_juliaMethod->setCacheDir(m_args->m_cacheDir);
+    m_juliaMethod->setReadDims(readDims(table.layout()));
+    m_juliaMethod->setLayout(table.layout());
+    m_juliaMethod->setWriteDims(writeDims(table.layout()));
+    if (m_args->m_dirtyCheck == "identity")
+        m_juliaMethod->setDirtyCheck(jlang::Invocation::DirtyCheck::Identity);
+    else if (m_args->m_dirtyCheck == "none")
+        m_juliaMethod->setDirtyCheck(jlang::Invocation::DirtyCheck::None);
 
+    // Compile before any points arrive, so the time isn't in the first view
+    m_juliaMethod->warmUp();
 }
 
 
-PointViewSet JuliaFilter::run(PointViewPtr view)
+Dimension::IdList JuliaFilter::readDims(PointLayoutPtr layout)
 {
-    log()->get(LogLevel::Debug5) << "filters.julia " << *m_script <<
-        " processing " << view->size() << " points." << std::endl;
+    StringList names = m_args->m_readDims;
+    if (names.empty())
+        return Dimension::IdList();
 
-    m_juliaMethod->execute(view, getMetadata());
+    if (names.size() == 1 && names[0] == "auto")
+    {
+        StringList all;
+        for (Dimension::Id id : layout->dims())
+            all.push_back(layout->dimName(id));
+        names = m_script->referencedDims(all);
+        for (const std::string& name : all)
+            if (!Utils::contains(names, name))
+                log()->get(LogLevel::Debug) << "filters.julia: dimension '" <<
+                    name << "' isn't named in the script, so isn't passed "
+                    "to it." << std::endl;
+    }
+
+    // Added dimensions are outputs of the function, so it always sees them.
+    for (const std::string& s : m_args->m_addDimensions)
+    {
+        std::string name = Utils::split(s, '=')[0];
+        Utils::trim(name);
+        if (!Utils::contains(names, name))
+            names.push_back(name);
+    }
 
+    Dimension::IdList dims;
+    for (const std::string& name : names)
+    {
+        Dimension::Id id = layout->findDim(name);
+        if (id == Dimension::Id::Unknown)
+            throwError("Invalid dimension '" + name + "' in 'read_dims'.");
+        dims.push_back(id);
+    }
+
+    log()->get(LogLevel::Debug) << "filters.julia passing " <<
+        dims.size() << " of " << layout->dims().size() <<
+        " dimensions to Julia." << std::endl;
+    return dims;
+}
+
+
+Dimension::IdList JuliaFilter::writeDims(PointLayoutPtr layout)
+{
+    Dimension::IdList dims;
+    for (const std::string& name : m_args->m_writeDims)
+    {
+        Dimension::Id id = layout->findDim(name);
+        if (id == Dimension::Id::Unknown)
+            throwError("Invalid dimension '" + name + "' in 'write_dims'.");
+        dims.push_back(id);
+    }
+    return dims;
+}
+
+
+PointViewSet JuliaFilter::run(PointViewPtr view)
+{
     PointViewSet viewSet;
-    viewSet.insert(view);
+
+    // In parallel, views are all run at once when the stage is done. That
+    // is still before any later stage sees them, so an empty view is
+    // returned now and filled with the points kept then.
+    if (m_args->m_parallel)
+    {
+        m_pending.push_back(view);
+        m_outputs.push_back(view->makeNew());
+        viewSet.insert(m_outputs.back());
+    }
+    else
+    {
+        log()->get(LogLevel::Debug5) << "filters.julia " << *m_script <<
+            " processing " << view->size() << " points." << std::endl;
+
+        // The function may keep only some of the points, or split them
+        if (m_daemon)
+            viewSet = m_daemon->execute(view, getMetadata());
+        else
+            viewSet = m_juliaMethod->execute(view, getMetadata());
+        if (m_groupDim != Dimension::Id::Unknown)
+            viewSet = groupBy(viewSet);
+    }
     return viewSet;
 }
 
 
+// Split views into one per value of the group_by dimension, in order of the
+// values. Only the index of each point is copied.
+PointViewSet JuliaFilter::groupBy(const PointViewSet& views) const
+{
+    PointViewSet groups;
+    for (const PointViewPtr& view : views)
+    {
+        std::map<double, std::vector<PointId>> rows;
+        for (PointId idx = 0; idx < view->size(); ++idx)
+            rows[view->getFieldAs<double>(m_groupDim, idx)].push_back(idx);
+
+        for (auto& group : rows)
+        {
+            PointViewPtr out = view->makeNew();
+            for (PointId idx : group.second)
+                out->appendPoint(*view, idx);
+            groups.insert(out);
+        }
+    }
+    return groups;
+}
+
+
+// Points are streamed through the table in chunks, and the filters of a
+// pipeline each see the whole chunk in turn, skipping the points an earlier
+// filter dropped. So the first point of a batch runs the function over the
+// points of the rest of the chunk that weren't skipped, or batch_size of
+// them, and the later points of the batch are already done when they
+// arrive. The batch ends at its last point, so the next point seen starts
+// another, whether or not the table was refilled in between.
+bool JuliaFilter::processOne(PointRef& point)
+{
+    const PointId idx = point.pointId();
+
+    if (!m_inBatch || idx < m_batch.front() || idx > m_batch.back())
+        runBatch(idx);
+    if (idx == m_batch.back())
+        m_inBatch = false;
+    return m_keep.empty() || m_keep[idx - m_batch.front()];
+}
+
+
+void JuliaFilter::runBatch(PointId first)
+{
+    if (!m_streamTable)
+        throwError("Streaming requires a stream point table.");
+    if (m_groupDim != Dimension::Id::Unknown)
+        throwError("Can't use 'group_by' when streaming.");
+
+    // Earlier filters have all finished with the chunk, so the points they
+    // skipped are known.
+    m_batch.clear();
+    for (PointId idx = first; idx < m_streamTable->numPoints(); ++idx)
+    {
+        if (idx != first && m_streamTable->skip(idx))
+            continue;
+        m_batch.push_back(idx);
+        if (m_batch.size() == m_args->m_batchSize)
+            break;
+    }
+
+    log()->get(LogLevel::Debug5) << "filters.julia " << *m_script <<
+        " processing " << m_batch.size() << " streamed points." << std::endl;
+
+    // Batches only add to the totals in the metadata, as there are many
+    jlang::ViewStorage storage(*m_streamTable, m_batch);
+    std::vector<PointId> rows;
+    m_keep.clear();
+    bool all = m_daemon ?
+        m_daemon->execute(storage, MetadataNode(), rows) :
+        m_juliaMethod->execute(storage, MetadataNode(), rows);
+    if (!all)
+    {
+        m_keep.resize(m_batch.back() - first + 1);
+        for (PointId idx : rows)
+            m_keep[m_batch[idx] - first] = true;
+    }
+    m_inBatch = true;
+}
+
+
 void JuliaFilter::done(PointTableRef table)
 {
+    if (m_pending.size())
+    {
+        log()->get(LogLevel::Debug5) << "filters.julia " << *m_script <<
+            " processing " << m_pending.size() << " views in parallel." <<
+            std::endl;
+
+        std::vector<PointViewSet> results =
+            m_juliaMethod->executeParallel(m_pending, getMetadata());
+        for (std::size_t i = 0; i < m_pending.size(); ++i)
+        {
+            // Views were returned from run() before this, so can't be split
+            if (results[i].size() != 1)
+                throwError("The function can't return several tables when "
+                    "'parallel' is set.");
+            m_outputs[i]->append(**results[i].begin());
+        }
+        m_pending.clear();
+        m_outputs.clear();
+    }
+    if (m_juliaMethod)
+        m_juliaMethod->addTimings(getMetadata());
+    else if (m_daemon)
+        m_daemon->addTimings(getMetadata());
     // static_cast<plang::Environment*>(plang::Environment::get())->reset_stdout();
 }
 
@@ -35,14 +35,18 @@
 #pragma once
 
 #include <pdal/Filter.hpp>
+#include <pdal/Streamable.hpp>
 #include <pdal/JsonFwd.hpp>
 
+#include "../jlang/DaemonClient.hpp"
 #include "../jlang/Invocation.hpp"
 
+#include <deque>
+
 namespace pdal
 {
 
-class PDAL_DLL JuliaFilter : public Filter
+class PDAL_DLL JuliaFilter : public Filter, public Streamable
 {
 public:
     JuliaFilter();
@@ -50,6 +54,10 @@ public:
 
     std::string getName() const;
 
+    // Registers the stage from this copy of the plugin, for programs that
+    // link it
+    static void registerLinked();
+
 private:
     JuliaFilter& operator=(const JuliaFilter&) = delete;
     JuliaFilter(const JuliaFilter&) = delete;
@@ -59,10 +67,29 @@ private:
     virtual void prepared(PointTableRef table);
     virtual void ready(PointTableRef table);
     virtual PointViewSet run(PointViewPtr view);
+    virtual bool processOne(PointRef& point);
     virtual void done(PointTableRef table);
 
+    Dimension::IdList readDims(PointLayoutPtr layout);
+    Dimension::IdList writeDims(PointLayoutPtr layout);
+    void runBatch(PointId first);
+    PointViewSet groupBy(const PointViewSet& views) const;
+
     std::unique_ptr<jlang::Script> m_script;
     std::unique_ptr<jlang::Invocation> m_juliaMethod;
+    std::unique_ptr<jlang::DaemonClient> m_daemon;
+    Dimension::Id m_groupDim;
+
+    // Views waiting to be run in parallel when the stage is done, and the
+    // views run() returned for them
+    std::vector<PointViewPtr> m_pending;
+    std::vector<PointViewPtr> m_outputs;
+
+    // Streaming: the table being streamed and the batch of it being run
+    StreamPointTable* m_streamTable;
+    bool m_inBatch;
+    std::deque<PointId> m_batch;   // Positions of the batch in the table
+    std::vector<bool> m_keep;      // Points of the batch kept, if not all
 
     struct Args;
     std::unique_ptr<Args> m_args;
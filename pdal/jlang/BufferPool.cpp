@@ -0,0 +1,128 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#include "BufferPool.hpp"
+
+#include <cstdlib>
+
+namespace pdal
+{
+namespace jlang
+{
+
+BufferPool::~BufferPool()
+{
+    for (auto& bucket : m_free)
+        for (char *buf : bucket.second)
+            free(buf);
+}
+
+
+std::size_t BufferPool::bucket(std::size_t size)
+{
+    std::size_t b = 4096;
+    while (b < size)
+        b <<= 1;
+    return b;
+}
+
+
+char *BufferPool::acquire(std::size_t size)
+{
+    const std::size_t b = bucket(size);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_free.find(b);
+        if (it != m_free.end() && it->second.size())
+        {
+            char *buf = it->second.back();
+            it->second.pop_back();
+            m_held -= b;
+            return buf;
+        }
+    }
+
+    char *buf = (char *)malloc(b);
+    if (!buf)
+        throw pdal_error("filters.julia: unable to allocate " +
+            std::to_string(b) + " bytes.");
+    return buf;
+}
+
+
+void BufferPool::release(char *buf, std::size_t size)
+{
+    if (!buf)
+        return;
+
+    const std::size_t b = bucket(size);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_held + b <= m_limit)
+        {
+            m_free[b].push_back(buf);
+            m_held += b;
+            return;
+        }
+    }
+    free(buf);
+}
+
+
+std::size_t BufferPool::held() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_held;
+}
+
+
+void BufferPool::setLimit(std::size_t limit)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_limit = limit;
+    for (auto it = m_free.rbegin(); it != m_free.rend() && m_held > m_limit;
+            ++it)
+    {
+        std::vector<char *>& bufs = it->second;
+        while (bufs.size() && m_held > m_limit)
+        {
+            free(bufs.back());
+            bufs.pop_back();
+            m_held -= it->first;
+        }
+    }
+}
+
+} // namespace jlang
+} // namespace pdal
@@ -0,0 +1,96 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#pragma once
+
+#include <pdal/pdal_internal.hpp>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace pdal
+{
+namespace jlang
+{
+
+// Buffers for the columns copied into Julia, reused from call to call so a
+// stage running over many views or batches doesn't allocate for each.
+// Sizes are rounded up to a power of two so that views of similar sizes
+// share buffers.
+//
+// Julia is given the memory without owning it, so a buffer is only
+// released once the call it was passed to is done, and arrays passed to
+// the function aren't valid after it returns.
+//
+// Free buffers are held up to a limit, past which released buffers are
+// freed, so a burst of views run at once doesn't stay allocated.
+class PDAL_DLL BufferPool
+{
+public:
+    static const std::size_t DefaultLimit = std::size_t(256) << 20;
+
+    BufferPool(std::size_t limit = DefaultLimit) : m_limit(limit), m_held(0)
+    {}
+    ~BufferPool();
+
+    BufferPool& operator=(const BufferPool&) = delete;
+    BufferPool(const BufferPool&) = delete;
+
+    // Get a buffer of at least size bytes
+    char *acquire(std::size_t size);
+
+    // Return a buffer acquired for size bytes
+    void release(char *buf, std::size_t size);
+
+    // Bytes held in free buffers
+    std::size_t held() const;
+
+    // Hold no more than limit bytes of free buffers, freeing the largest
+    // past it
+    void setLimit(std::size_t limit);
+
+    // The size of the buffer acquired for size bytes
+    static std::size_t bucket(std::size_t size);
+
+private:
+
+    mutable std::mutex m_mutex;
+    std::map<std::size_t, std::vector<char *>> m_free;
+    std::size_t m_limit;
+    std::size_t m_held;
+};
+
+} // namespace jlang
+} // namespace pdal
@@ -0,0 +1,390 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#include "DaemonClient.hpp"
+#include "Kernels.hpp"
+
+#include <pdal/util/Algorithm.hpp>
+#include <pdal/util/FileUtils.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace pdal
+{
+namespace jlang
+{
+
+namespace
+{
+
+// Columns start on cache lines in the mapped file, which also aligns them
+// for any element type.
+const std::size_t Alignment = 64;
+
+#ifdef MSG_NOSIGNAL
+const int SendFlags = MSG_NOSIGNAL;
+#else
+const int SendFlags = 0;
+#endif
+
+[[noreturn]] void fail(const std::string& what)
+{
+    throw pdal_error("filters.julia: " + what + ": " +
+        std::strerror(errno) + ".");
+}
+
+} // unnamed namespace
+
+DaemonClient::DaemonClient(const std::string& socketPath,
+        const Script& script) :
+    m_script(script), m_scriptSent(false), m_socketPath(socketPath),
+    m_socket(-1), m_mapFd(-1), m_map(nullptr), m_mapSize(0), m_chunks(1),
+    m_calls(0)
+{
+    // The key names the script, module and function in later requests
+    std::string named = std::string(script.source()) + "\n" +
+        script.module() + "\n" + script.function();
+    std::ostringstream key;
+    key << std::hex << std::setw(16) << std::setfill('0') <<
+        checksum(named.data(), named.size());
+    m_scriptKey = key.str();
+
+    sockaddr_un addr;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+        throw pdal_error("filters.julia: daemon socket path '" +
+            socketPath + "' is too long.");
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    m_socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_socket < 0)
+        fail("can't create socket");
+    if (::connect(m_socket, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        int err = errno;
+        ::close(m_socket);
+        errno = err;
+        fail("can't connect to Julia daemon at '" + socketPath + "'");
+    }
+
+    // Files in /dev/shm are held in memory, so nothing is written to disk
+    std::string dir = FileUtils::directoryExists("/dev/shm") ?
+        "/dev/shm" : "/tmp";
+    std::string path = dir + "/pdal-julia-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back(0);
+    m_mapFd = ::mkstemp(name.data());
+    if (m_mapFd < 0)
+    {
+        int err = errno;
+        ::close(m_socket);
+        errno = err;
+        fail("can't create file in '" + dir + "' to pass columns in");
+    }
+    m_mapPath = name.data();
+}
+
+
+DaemonClient::~DaemonClient()
+{
+    if (m_map)
+        ::munmap(m_map, m_mapSize);
+    ::close(m_mapFd);
+    ::unlink(m_mapPath.c_str());
+    ::close(m_socket);
+}
+
+
+// Grow the mapped file to hold at least size bytes. It's never shrunk, as
+// the daemon keeps its own mapping of it.
+void DaemonClient::reserve(std::size_t size)
+{
+    if (size <= m_mapSize)
+        return;
+    size = (std::max)(size, 2 * m_mapSize);
+
+    if (m_map)
+        ::munmap(m_map, m_mapSize);
+    m_map = nullptr;
+    m_mapSize = 0;
+    if (::ftruncate(m_mapFd, (off_t)size) != 0)
+        fail("can't resize '" + m_mapPath + "'");
+    void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+        m_mapFd, 0);
+    if (p == MAP_FAILED)
+        fail("can't map '" + m_mapPath + "'");
+    m_map = (char *)p;
+    m_mapSize = size;
+}
+
+
+void DaemonClient::send(const std::string& s)
+{
+    const char *p = s.data();
+    std::size_t left = s.size();
+    while (left)
+    {
+        ssize_t n = ::send(m_socket, p, left, SendFlags);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            fail("can't send to Julia daemon at '" + m_socketPath + "'");
+        p += n;
+        left -= (std::size_t)n;
+    }
+}
+
+
+void DaemonClient::receive(char *dst, std::size_t size)
+{
+    while (size)
+    {
+        ssize_t n = ::recv(m_socket, dst, size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0)
+            throw pdal_error("filters.julia: Julia daemon at '" +
+                m_socketPath + "' closed the connection.");
+        if (n < 0)
+            fail("can't receive from Julia daemon at '" + m_socketPath + "'");
+        dst += n;
+        size -= (std::size_t)n;
+    }
+}
+
+
+// Replies are short, so are read a byte at a time rather than buffered
+std::string DaemonClient::receiveLine()
+{
+    std::string line;
+    char c;
+    while (true)
+    {
+        receive(&c, 1);
+        if (c == '\n')
+            return line;
+        line += c;
+    }
+}
+
+
+bool DaemonClient::writable(Dimension::Id id) const
+{
+    return m_writeDims.empty() || Utils::contains(m_writeDims, id);
+}
+
+
+PointViewSet DaemonClient::execute(PointViewPtr v,
+    MetadataNode stageMetadata)
+{
+    ViewStorage storage(*v);
+    std::vector<PointId> rows;
+    PointViewSet views;
+    if (execute(storage, stageMetadata, rows))
+        views.insert(v);
+    else
+    {
+        PointViewPtr kept = v->makeNew();
+        for (PointId idx : rows)
+            kept->appendPoint(*v, idx);
+        views.insert(kept);
+    }
+    return views;
+}
+
+
+// The columns passed for count points, and the size of the file they need
+std::vector<DaemonClient::Column> DaemonClient::columns(PointLayoutPtr layout,
+    point_count_t count, std::size_t& size) const
+{
+    const Dimension::IdList& dims =
+        m_readDims.empty() ? layout->dims() : m_readDims;
+
+    std::vector<Column> columns;
+    size = 0;
+    for (Dimension::Id d : dims)
+    {
+        const Dimension::Detail *dd = layout->dimDetail(d);
+        if (typeIndex(dd->type()) == NumScalarTypes)
+            throw pdal_error("filters.julia: dimension '" +
+                layout->dimName(d) + "' has a type unsupported in Julia.");
+        std::size_t bytes = dd->size() * count;
+        columns.push_back({ d, dd, size, bytes, 0 });
+        size += (bytes + Alignment - 1) / Alignment * Alignment;
+    }
+    size = (std::max)(size, Alignment);
+    return columns;
+}
+
+
+// A request names the mapped file and the columns in it, and the script by
+// a key. The first request on a connection also carries the script's
+// source, which the daemon compiles the first time it sees it, and later
+// ones send no source and are matched to it by the key:
+//
+//   run <path> <file size> <points> <chunks>
+//   script <key> <module> <function> <source bytes>
+//   <source>                                   (first request only)
+//   dim <name> <kernel type index> <offset>    (one per column)
+//   end
+//
+// The daemon leaves the columns it returns in the file, and replies "ok",
+// or "keep <n>" followed by the 1-based indices of the points kept as n
+// 64-bit integers, or "error <message>". A "warm" request has the same
+// form, and only compiles the function for the columns.
+void DaemonClient::request(const std::string& verb, PointLayoutPtr layout,
+    point_count_t count, const std::vector<Column>& columns)
+{
+    std::size_t sourceSize =
+        m_scriptSent ? 0 : std::strlen(m_script.source());
+
+    std::ostringstream out;
+    out << verb << " " << m_mapPath << " " << m_mapSize << " " << count <<
+        " " << m_chunks << "\n";
+    out << "script " << m_scriptKey << " " << m_script.module() << " " <<
+        m_script.function() << " " << sourceSize << "\n";
+    out.write(m_script.source(), sourceSize);
+    for (const Column& c : columns)
+        out << "dim " << layout->dimName(c.m_id) << " " <<
+            typeIndex(c.m_detail->type()) << " " << c.m_offset << "\n";
+    out << "end\n";
+    send(out.str());
+    m_scriptSent = true;
+}
+
+
+void DaemonClient::warmUp(PointLayoutPtr layout)
+{
+    Stopwatch sw;
+    std::size_t size;
+    std::vector<Column> cols = columns(layout, 0, size);
+    reserve(size);
+    request("warm", layout, 0, cols);
+
+    std::string reply = receiveLine();
+    if (reply.compare(0, 6, "error ") == 0)
+        throw pdal_error("filters.julia: " + reply.substr(6));
+    m_warmUpTime = sw.elapsed();
+}
+
+
+bool DaemonClient::execute(ViewStorage& storage, MetadataNode stageMetadata,
+    std::vector<PointId>& rows)
+{
+    PointLayoutPtr layout = storage.layout();
+    const point_count_t count = storage.size();
+    Invocation::Stats stats;
+    stats.m_points = count;
+
+    Stopwatch sw;
+    std::size_t size;
+    std::vector<Column> cols = columns(layout, count, size);
+    reserve(size);
+    for (Column& c : cols)
+    {
+        storage.gather(c.m_detail, c.m_detail->type(), m_map + c.m_offset);
+        c.m_checksum = checksum(m_map + c.m_offset, c.m_bytes);
+        stats.m_bytesIn += c.m_bytes;
+    }
+    stats.m_marshalIn = sw.elapsed();
+
+    sw.restart();
+    request("run", layout, count, cols);
+
+    bool selected = false;
+    std::string reply = receiveLine();
+    if (reply.compare(0, 6, "error ") == 0)
+        throw pdal_error("filters.julia: " + reply.substr(6));
+    else if (reply.compare(0, 5, "keep ") == 0)
+    {
+        std::vector<int64_t> indices(std::stoull(reply.substr(5)));
+        receive((char *)indices.data(), indices.size() * sizeof(int64_t));
+        rows.clear();
+        rows.reserve(indices.size());
+        for (int64_t i : indices)
+        {
+            if (i < 1 || (point_count_t)i > count)
+                throw pdal_error("filters.julia: point index " +
+                    std::to_string(i) + " returned by the function is out "
+                    "of range.");
+            rows.push_back(PointId(i - 1));
+        }
+        selected = true;
+    }
+    else if (reply != "ok")
+        throw pdal_error("filters.julia: unexpected reply '" + reply +
+            "' from Julia daemon.");
+    stats.m_function = sw.elapsed();
+
+    // The daemon wrote changed columns into the file, in place
+    sw.restart();
+    for (const Column& c : cols)
+        if (writable(c.m_id) &&
+                checksum(m_map + c.m_offset, c.m_bytes) != c.m_checksum)
+        {
+            storage.scatter(c.m_detail, c.m_detail->type(),
+                m_map + c.m_offset, count);
+            stats.m_bytesOut += c.m_bytes;
+        }
+    stats.m_marshalOut = sw.elapsed();
+
+    m_calls++;
+    m_totals += stats;
+    if (stageMetadata.valid())
+        Invocation::addStats(
+            Invocation::timingsNode(stageMetadata).add("view"), stats);
+    return !selected;
+}
+
+
+void DaemonClient::addTimings(MetadataNode stageMetadata) const
+{
+    MetadataNode n = Invocation::timingsNode(stageMetadata);
+    Invocation::addTiming(n, "warm_up", m_warmUpTime);
+    n.add("calls", m_calls);
+    Invocation::addStats(n.add("total"), m_totals);
+}
+
+} // namespace jlang
+} // namespace pdal
@@ -0,0 +1,142 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#pragma once
+
+#include <pdal/pdal_internal.hpp>
+
+#include "Invocation.hpp"
+#include "Script.hpp"
+#include "Stopwatch.hpp"
+#include "ViewStorage.hpp"
+
+#include <pdal/Dimension.hpp>
+#include <pdal/PointView.hpp>
+
+namespace pdal
+{
+namespace jlang
+{
+
+// Runs the function in a separate, long-lived Julia process started with
+// jl/Daemon.jl, instead of in this one, so jobs don't each pay for starting
+// Julia and compiling the script. Requests go over a Unix socket, and the
+// columns are copied into a file that both processes map, kept under
+// /dev/shm where there is one. The daemon can change columns and select
+// points, but not add points or split them.
+class PDAL_DLL DaemonClient
+{
+public:
+    DaemonClient(const std::string& socketPath, const Script& script);
+    DaemonClient& operator=(const DaemonClient&) = delete;
+    DaemonClient(const DaemonClient&) = delete;
+    ~DaemonClient();
+
+    // Run the function over a view. Returns v, or a view of the points it
+    // kept.
+    PointViewSet execute(PointViewPtr v, MetadataNode stageMetadata);
+
+    // Run the function over a set of points. If it keeps only some of them,
+    // returns false and sets rows to the positions of those kept.
+    bool execute(ViewStorage& storage, MetadataNode stageMetadata,
+        std::vector<PointId>& rows);
+
+    // Have the daemon compile the function for the dimensions of the
+    // layout, before any points are sent.
+    void warmUp(PointLayoutPtr layout);
+
+    // As Invocation::setReadDims(), setWriteDims() and setChunks()
+    void setReadDims(const Dimension::IdList& dims)
+    {
+        m_readDims = dims;
+    }
+    void setWriteDims(const Dimension::IdList& dims)
+    {
+        m_writeDims = dims;
+    }
+    void setChunks(int chunks)
+    {
+        m_chunks = chunks;
+    }
+
+    // Add the time taken compiling the function and the totals of every
+    // call so far, as Invocation::addTimings() does. Copying the columns
+    // into and out of the file is marshalling, and a request from sending
+    // it to the reply is the function.
+    void addTimings(MetadataNode stageMetadata) const;
+
+private:
+    // A dimension as it's laid out in the mapped file
+    struct Column
+    {
+        Dimension::Id m_id;
+        const Dimension::Detail *m_detail;
+        std::size_t m_offset;
+        std::size_t m_bytes;
+        uint64_t m_checksum;
+    };
+
+    std::vector<Column> columns(PointLayoutPtr layout, point_count_t count,
+        std::size_t& size) const;
+    void request(const std::string& verb, PointLayoutPtr layout,
+        point_count_t count, const std::vector<Column>& columns);
+    void reserve(std::size_t size);
+    void send(const std::string& s);
+    std::string receiveLine();
+    void receive(char *dst, std::size_t size);
+    bool writable(Dimension::Id id) const;
+
+    Script m_script;
+    std::string m_scriptKey;
+    bool m_scriptSent;
+    std::string m_socketPath;
+    int m_socket;
+
+    // The file the columns are passed in, and its mapping
+    std::string m_mapPath;
+    int m_mapFd;
+    char *m_map;
+    std::size_t m_mapSize;
+
+    Dimension::IdList m_readDims;
+    Dimension::IdList m_writeDims;
+    int m_chunks;
+
+    Timing m_warmUpTime;
+    std::size_t m_calls;
+    Invocation::Stats m_totals;
+};
+
+} // namespace jlang
+} // namespace pdal
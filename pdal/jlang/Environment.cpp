@@ -0,0 +1,387 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#include "Environment.hpp"
+#include "PointIndex.hpp"
+
+#include <pdal/util/FileUtils.hpp>
+
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+  #include <Windows.h>
+#else
+  #include <dlfcn.h>
+#endif
+
+namespace pdal
+{
+namespace jlang
+{
+
+namespace
+{
+
+// Matches jl/PdalJulia/Project.toml
+#define PDAL_JULIA_WRAPPER_UUID "b4a5c407-76fd-40f4-8c72-271236d78291"
+
+std::mutex s_mutex;
+std::weak_ptr<Environment> s_environment;
+bool s_started = false;
+
+// Calls posted to the thread serving them
+std::mutex s_callMutex;
+std::condition_variable s_callPosted;
+std::deque<std::packaged_task<void()>*> s_calls;
+bool s_serving = false;
+std::thread::id s_server;
+
+void shutdown()
+{
+    jl_atexit_hook(0);
+}
+
+} // unnamed namespace
+
+
+EnvironmentPtr Environment::get(int threads)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    // Julia reads its thread count from the environment as it starts
+    if (!s_started && threads > 0)
+        Utils::setenv("JULIA_NUM_THREADS", std::to_string(threads));
+
+    EnvironmentPtr env = s_environment.lock();
+    if (!env)
+    {
+        env.reset(new Environment);
+        s_environment = env;
+    }
+    return env;
+}
+
+
+Environment::Environment() : m_wrapper(nullptr), m_runStage(nullptr),
+    m_spawnStage(nullptr), m_fetch(nullptr), m_refs(nullptr),
+    m_startTaken(false)
+{
+    Stopwatch sw;
+    if (!s_started)
+    {
+        start();
+        s_started = true;
+    }
+    loadWrapper();
+    m_startTime = sw.elapsed();
+
+    // Values held by C++ are rooted by storing them in a global IdDict
+    m_refs = jl_eval_string("isdefined(Main, :__pdal_julia_refs) || "
+        "(const global __pdal_julia_refs = IdDict()); __pdal_julia_refs");
+    m_setindex = jl_get_function(jl_base_module, "setindex!");
+    m_delete = jl_get_function(jl_base_module, "delete!");
+    m_fetch = jl_get_function(jl_base_module, "fetch");
+}
+
+
+Environment::~Environment()
+{}
+
+
+bool Environment::takeStartTime(Timing& t)
+{
+    if (m_startTaken.exchange(true))
+        return false;
+    t = m_startTime;
+    return true;
+}
+
+
+/*
+ * Setup the Julia context
+ */
+void Environment::start()
+{
+    // dynamically load this same module into itself. PDAL doesn't set the RTLD_GLOBAL flag
+    // so Julia doesn't initialise correctly. This can be removed if 
+    //
+    // https://github.com/PDAL/PDAL/blob/master/pdal/DynamicLibrary.cpp#L96
+    //
+    // is changed to add that flag. See details here:
+    //
+    // https://discourse.julialang.org/t/different-behaviours-in-linux-and-macos-with-julia-embedded-in-c/18101/15
+    //
+    void *handle;
+    handle = dlopen("libpdal_plugin_filter_julia.so", RTLD_NOW | RTLD_GLOBAL);
+    if (!handle)
+        throw pdal_error(std::string("filters.julia: ") + dlerror());
+
+    // Load Julia with packages precompiled into a custom sysimage. This makes packaging easier,
+    // and allows quick startup of the interpreter.
+    std::string driver_path;
+    Utils::getenv("PDAL_DRIVER_PATH", driver_path);
+
+    jl_init_with_image(driver_path.c_str(), "pdal_jl_sys.so");
+    std::atexit(shutdown);
+}
+
+
+void Environment::loadWrapper()
+{
+    // PdalJulia is compiled into the sysimage as a package, but isn't bound
+    // in Main until something imports it.
+    jl_value_t* wrapper = jl_eval_string(
+        "let id = Base.PkgId(Base.UUID(\"" PDAL_JULIA_WRAPPER_UUID "\"), "
+        "\"PdalJulia\")\n"
+        "  haskey(Base.loaded_modules, id) ? Base.loaded_modules[id] : "
+        "    (isdefined(Main, :PdalJulia) ? Main.PdalJulia : nothing)\n"
+        "end");
+
+    // Otherwise fall back to evaluating the runtime from source
+    if (!wrapper || jl_is_nothing(wrapper))
+    {
+        std::string runtime_path;
+        Utils::getenv("PDAL_JULIA_RUNTIME_PATH", runtime_path);
+
+        // For local dev
+        if (runtime_path == "") {
+          runtime_path = "../jl/PdalJulia/src";
+        }
+
+        std::string wrapperModuleSrc = FileUtils::readFileIntoString(runtime_path + "/PdalJulia.jl");
+        if (wrapperModuleSrc == "")
+            throw pdal_error("filters.julia: unable to find PdalJulia.jl "
+                "runtime file at: " + runtime_path);
+
+        jl_eval_string(wrapperModuleSrc.c_str());
+        wrapper = jl_eval_string("PdalJulia");
+    }
+    if (jl_exception_occurred() || !wrapper)
+        throw pdal_error("filters.julia: unable to load the PdalJulia "
+            "runtime module.");
+
+    m_wrapper = (jl_module_t*) wrapper;
+    jl_set_global(jl_main_module, jl_symbol("PdalJulia"), wrapper);
+
+    // Looked up once here rather than for every view. Bound in the module,
+    // so it is rooted for as long as the module is.
+    m_runStage = jl_get_function(m_wrapper, "runStage");
+    m_spawnStage = jl_get_function(m_wrapper, "spawnStage");
+    if (!m_runStage || !m_spawnStage)
+        throw pdal_error("filters.julia: PdalJulia runtime is missing "
+            "runStage or spawnStage.");
+
+    // Neighbourhood queries in scripts call back into the view's index
+    jl_value_t* radius = nullptr;
+    jl_value_t* knn = nullptr;
+    jl_value_t* error = nullptr;
+    JL_GC_PUSH3(&radius, &knn, &error);
+    radius = jl_box_voidpointer((void *)&PointIndex::radius);
+    knn = jl_box_voidpointer((void *)&PointIndex::knn);
+    error = jl_box_voidpointer((void *)&PointIndex::error);
+    jl_call3(jl_get_function(m_wrapper, "setIndexFunctions"), radius, knn,
+        error);
+    JL_GC_POP();
+    if (jl_exception_occurred())
+        throw pdal_error("filters.julia: unable to pass the point index "
+            "functions to the PdalJulia runtime.");
+}
+
+std::string Environment::errorMessage(jl_value_t* exc)
+{
+    std::string msg(jl_typeof_str(exc));
+    jl_value_t* text = nullptr;
+    JL_GC_PUSH2(&exc, &text);
+    text = jl_call2(jl_get_function(jl_base_module, "sprint"),
+        jl_get_function(jl_base_module, "showerror"), exc);
+    if (!jl_exception_occurred() && text && jl_is_string(text))
+        msg += ": " + std::string(jl_string_ptr(text));
+    JL_GC_POP();
+    return msg;
+}
+
+
+void Environment::retain(jl_value_t* value)
+{
+    jl_call3(m_setindex, m_refs, value, value);
+}
+
+
+void Environment::release(jl_value_t* value)
+{
+    jl_call2(m_delete, m_refs, value);
+}
+
+
+jl_function_t* Environment::function(const Script& script,
+    const std::string& cacheDir, jl_value_t* schema)
+{
+    auto key = std::make_tuple(std::string(script.source()),
+        std::string(script.module()), std::string(script.function()));
+    auto it = m_functions.find(key);
+    if (it != m_functions.end())
+        return it->second;
+
+    jl_function_t* fn = nullptr;
+    if (cacheDir.size() && schema)
+        fn = loadCached(script, cacheDir, schema);
+
+    // Otherwise evaluate the source in Main
+    if (!fn)
+    {
+        jl_eval_string(script.source());
+        jl_value_t* mod = jl_eval_string(script.module());
+        if (!jl_exception_occurred() && mod && jl_is_module(mod))
+            fn = jl_get_function((jl_module_t*) mod, script.function());
+    }
+    if (jl_exception_occurred() || !fn)
+        throw pdal_error(std::string("filters.julia: unable to load ") +
+            script.module() + "." + script.function() + " from the script" +
+            (jl_exception_occurred() ? std::string(": ") +
+                errorMessage(jl_exception_occurred()) : std::string()) +
+            ".");
+
+    // Another stage may load a module with the same name, replacing this
+    // one, so the function is kept rooted for as long as it's cached.
+    retain(fn);
+    m_functions[key] = fn;
+    return fn;
+}
+
+
+// PdalJulia.loadCached, which returns nothing if the cache can't be used
+jl_function_t* Environment::loadCached(const Script& script,
+    const std::string& cacheDir, jl_value_t* schema)
+{
+    jl_function_t* load = jl_get_function(m_wrapper, "loadCached");
+    if (!load)
+        return nullptr;
+
+    jl_value_t** args;
+    JL_GC_PUSHARGS(args, 5);
+    args[0] = jl_cstr_to_string(cacheDir.c_str());
+    args[1] = jl_cstr_to_string(script.source());
+    args[2] = jl_cstr_to_string(script.module());
+    args[3] = jl_cstr_to_string(script.function());
+    args[4] = schema;
+    jl_value_t* fn = jl_call(load, args, 5);
+    JL_GC_POP();
+
+    if (jl_exception_occurred() || !fn || jl_is_nothing(fn))
+        return nullptr;
+    return (jl_function_t*) fn;
+}
+
+
+void Environment::call(const std::function<void()>& fn)
+{
+    std::packaged_task<void()> task(fn);
+    std::future<void> done = task.get_future();
+    bool posted = false;
+    {
+        std::lock_guard<std::mutex> lock(s_callMutex);
+        if (s_serving && std::this_thread::get_id() != s_server)
+        {
+            s_calls.push_back(&task);
+            posted = true;
+        }
+    }
+
+    // Calls may nest, so the lock isn't held while running one
+    if (posted)
+        s_callPosted.notify_one();
+    else
+        task();
+    done.get();
+}
+
+
+void Environment::serve(const std::function<void()>& work)
+{
+    {
+        std::lock_guard<std::mutex> lock(s_callMutex);
+        if (s_serving)
+            throw pdal_error("filters.julia: Julia calls are already being "
+                "served.");
+        s_serving = true;
+        s_server = std::this_thread::get_id();
+    }
+
+    bool finished = false;
+    std::exception_ptr error;
+    std::thread worker([&]()
+    {
+        try
+        {
+            work();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(s_callMutex);
+        finished = true;
+        s_callPosted.notify_one();
+    });
+
+    // Once work has returned nothing more can be posted, so the queue is
+    // drained and serving stops.
+    std::unique_lock<std::mutex> lock(s_callMutex);
+    while (true)
+    {
+        s_callPosted.wait(lock,
+            [&finished]() { return finished || !s_calls.empty(); });
+        if (s_calls.empty())
+            break;
+        std::packaged_task<void()>* task = s_calls.front();
+        s_calls.pop_front();
+        lock.unlock();
+        (*task)();
+        lock.lock();
+    }
+    s_serving = false;
+    lock.unlock();
+
+    worker.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+} // namespace jlang
+} // namespace pdal
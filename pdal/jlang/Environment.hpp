@@ -0,0 +1,153 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#pragma once
+
+#include <julia.h>
+#include <pdal/pdal_internal.hpp>
+
+#include "Script.hpp"
+#include "Stopwatch.hpp"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <tuple>
+
+namespace pdal
+{
+namespace jlang
+{
+
+class Environment;
+typedef std::shared_ptr<Environment> EnvironmentPtr;
+
+// The Julia runtime shared by every filters.julia stage in the process.
+// Julia can only be initialised once per process, so the first handle
+// starts it and loads the PdalJulia wrapper module, and later handles reuse
+// both. Julia keeps running after the last handle is released, as it
+// can't be restarted; it is shut down when the process exits.
+class PDAL_DLL Environment
+{
+public:
+    ~Environment();
+
+    // Get a handle to the runtime, starting it if needed. Julia's thread
+    // count is fixed when it starts, so `threads` only applies then; 0 leaves
+    // it to JULIA_NUM_THREADS.
+    static EnvironmentPtr get(int threads = 0);
+
+    // The PdalJulia wrapper module
+    jl_module_t* wrapper() const
+    {
+        return m_wrapper;
+    }
+
+    // PdalJulia.runStage
+    jl_function_t* runStage() const
+    {
+        return m_runStage;
+    }
+
+    // PdalJulia.spawnStage, which runs runStage as a task
+    jl_function_t* spawnStage() const
+    {
+        return m_spawnStage;
+    }
+
+    // Base.fetch, to wait for a task's result
+    jl_function_t* fetch() const
+    {
+        return m_fetch;
+    }
+
+    // Time this runtime took to start Julia, if it had to, and load the
+    // wrapper module. Only the first stage to ask is given it, as the
+    // stages sharing the runtime after it didn't pay for starting it.
+    bool takeStartTime(Timing& t);
+
+    // Keep a value alive across calls into Julia until it's released
+    void retain(jl_value_t* value);
+    void release(jl_value_t* value);
+
+    // Load a script and get its function. A script loaded before by a
+    // stage sharing this runtime is reused, so it is only compiled once.
+    // With a cache directory, the script is loaded from a package
+    // precompiled there for the schema, compiling it the first time.
+    jl_function_t* function(const Script& script,
+        const std::string& cacheDir = "", jl_value_t* schema = nullptr);
+
+    // Julia can only be called from the thread that started it. A program
+    // running pipelines on several threads, like the batch driver, does its
+    // work through serve(), and stages reach Julia through call().
+
+    // Run fn on the thread serving calls and wait for it. Runs it directly
+    // when nothing is serving calls, or on the serving thread.
+    static void call(const std::function<void()>& fn);
+
+    // Run work on a new thread, and run the functions it passes to call()
+    // on this one until it returns. Rethrows anything work throws.
+    static void serve(const std::function<void()>& work);
+
+    // The type of a Julia exception and what showerror() says of it
+    static std::string errorMessage(jl_value_t* exc);
+
+private:
+    Environment();
+    Environment& operator=(Environment const& rhs) = delete;
+    Environment(const Environment& other) = delete;
+
+    void start();
+    void loadWrapper();
+    jl_function_t* loadCached(const Script& script,
+        const std::string& cacheDir, jl_value_t* schema);
+
+    jl_module_t* m_wrapper;
+    jl_function_t* m_runStage;
+    jl_function_t* m_spawnStage;
+    jl_function_t* m_fetch;
+    jl_value_t* m_refs;
+    jl_function_t* m_setindex;
+    jl_function_t* m_delete;
+    Timing m_startTime;
+    std::atomic<bool> m_startTaken;
+
+    // Functions by (source, module, function)
+    std::map<std::tuple<std::string, std::string, std::string>,
+        jl_function_t*> m_functions;
+};
+
+} // namespace jlang
+} // namespace pdal
@@ -33,16 +33,15 @@
 ****************************************************************************/
 
 #include "Invocation.hpp"
+#include "Kernels.hpp"
+#include "ViewStorage.hpp"
 
 #include <pdal/util/Algorithm.hpp>
 #include <pdal/util/FileUtils.hpp>
 #include <julia.h>
 
-#ifdef _WIN32
-  #include <Windows.h>
-#else
-  #include <dlfcn.h>
-#endif
+#include <deque>
+#include <future>
 
 namespace pdal
 {
@@ -50,110 +49,237 @@ namespace pdal
 namespace jlang
 {
 
+void Invocation::addTiming(MetadataNode parent, const std::string& name,
+    const Timing& t)
+{
+    MetadataNode n = parent.add(name);
+    n.add("wall", t.m_wall, "Wall clock time (s)");
+    n.add("cpu", t.m_cpu, "Process CPU time, over all threads (s)");
+}
+
+// Timings go in a single "timings" node of the stage's metadata
+MetadataNode Invocation::timingsNode(MetadataNode stageMetadata)
+{
+    MetadataNode n = stageMetadata.findChild("timings");
+    return n.valid() ? n : stageMetadata.add("timings");
+}
+
+void Invocation::addStats(MetadataNode n, const Stats& stats)
+{
+    addTiming(n, "marshal_in", stats.m_marshalIn);
+    addTiming(n, "function", stats.m_function);
+    addTiming(n, "marshal_out", stats.m_marshalOut);
+    n.add("points", stats.m_points);
+    n.add("bytes_in", stats.m_bytesIn, "Bytes copied into Julia");
+    n.add("bytes_out", stats.m_bytesOut, "Bytes copied back from Julia");
+
+    double wall = stats.m_marshalIn.m_wall + stats.m_function.m_wall +
+        stats.m_marshalOut.m_wall;
+    if (wall > 0)
+        n.add("points_per_second", stats.m_points / wall);
+}
+
+Invocation::Stats& Invocation::Stats::operator+=(const Stats& other)
+{
+    m_marshalIn += other.m_marshalIn;
+    m_function += other.m_function;
+    m_marshalOut += other.m_marshalOut;
+    m_points += other.m_points;
+    m_bytesIn += other.m_bytesIn;
+    m_bytesOut += other.m_bytesOut;
+    return *this;
+}
+
 Invocation::Invocation(const Script& script, MetadataNode m,
-        const std::string& pdalArgs) :
-    m_script(script), m_inputMetadata(m), m_pdalargs(pdalArgs)
+        const std::string& pdalArgs, int threads) :
+    m_function(nullptr), m_script(script), m_schema(nullptr),
+    m_dirtyCheck(DirtyCheck::Checksum),
+    m_chunks(1), m_windowSize(0), m_memoryLimit(0), m_startedJulia(false),
+    m_calls(0), m_inputMetadata(m), m_pdalargs(pdalArgs)
 {
-    // Environment::get();
-    initialise();
-    compile();
+    Environment::call([&]() { m_env = Environment::get(threads); });
+    m_startedJulia = m_env->takeStartTime(m_startTime);
 }
 
-/*
- * Setup the Julia context
- */
-void Invocation::initialise()
-{
-    // dynamically load this same module into itself. PDAL doesn't set the RTLD_GLOBAL flag
-    // so Julia doesn't initialise correctly. This can be removed if 
-    //
-    // https://github.com/PDAL/PDAL/blob/master/pdal/DynamicLibrary.cpp#L96
-    //
-    // is changed to add that flag. See details here:
-    //
-    // https://discourse.julialang.org/t/different-behaviours-in-linux-and-macos-with-julia-embedded-in-c/18101/15
-    //
-    void *handle;
-    handle = dlopen("libpdal_plugin_filter_julia.so", RTLD_NOW | RTLD_GLOBAL);
-    if (!handle) {
-        fprintf (stderr, "%s\n", dlerror());
-        exit(1);
-    }
+Invocation::~Invocation()
+{
+    if (m_schema)
+        Environment::call([this]() { m_env->release(m_schema); });
+}
 
-    // Load Julia with packages precompiled into a custom sysimage. This makes packaging easier,
-    // and allows quick startup of the interpreter.
-    std::string driver_path;
-    Utils::getenv("PDAL_DRIVER_PATH", driver_path);
+// Compiling can fail where running wouldn't, for instance if the function
+// isn't defined for every table, so failures are left to the first call.
+void Invocation::warmUp()
+{
+    if (!m_schema)
+        return;
 
-    jl_init_with_image(driver_path.c_str(), "pdal_jl_sys.so");
+    Environment::call([this]()
+    {
+        Stopwatch sw;
+        jl_function_t* warm = jl_get_function(m_env->wrapper(), "warmUp");
+        if (warm)
+            jl_call2(warm, m_schema, (jl_value_t*) m_function);
+        m_warmUpTime = sw.elapsed();
+    });
 }
 
-void Invocation::compile()
+// Find the memory of each dimension passed to Julia, gathering a copy of
+// those that aren't packed in the point table. Makes no calls into Julia,
+// so can run on any thread.
+void Invocation::gather(Call& call) const
 {
-    std::string runtime_path;
-    Utils::getenv("PDAL_JULIA_RUNTIME_PATH", runtime_path);
+    ViewStorage& storage = call.m_storage;
+    PointLayoutPtr layout(storage.layout());
+
+    call.m_columns.clear();
+    call.m_stats.m_points = storage.size();
+    for (Dimension::Id d : m_dims)
+    {
+        const Dimension::Detail *dd = layout->dimDetail(d);
+
+        // Hand Julia the table's own memory when the column is packed,
+        // otherwise gather a copy of it. Changes made in place to the
+        // table's memory can't be undone, so a dimension that isn't to be
+        // written back is always copied.
+        std::vector<Span> spans = storage.spans(dd);
+        Column column { d, nullptr, dd->size() * storage.size(), false, 0 };
+        const bool writable = m_writeDims.empty() ||
+            Utils::contains(m_writeDims, d);
+        if (writable && spans.size() == 1 &&
+                spans[0].m_stride == (std::ptrdiff_t)dd->size())
+        {
+            column.m_data = spans[0].m_data;
+            column.m_shared = true;
+            call.m_columns.push_back(column);
+            continue;
+        }
 
-    // For local dev
-    if (runtime_path == "") {
-      runtime_path = "../jl";
+        // The call holds the buffer from here, so it goes back to the pool
+        // even if gathering fails.
+        column.m_data = call.m_pool.acquire(column.m_bytes);
+        call.m_columns.push_back(column);
+
+        Column& copy = call.m_columns.back();
+        storage.gather(dd, dd->type(), (char *)copy.m_data, spans);
+        call.m_stats.m_bytesIn += copy.m_bytes;
+        if (m_dirtyCheck == DirtyCheck::Checksum)
+            copy.m_checksum = checksum(copy.m_data, copy.m_bytes);
     }
+}
+
+// Fix the dimensions passed to Julia, and build the schema of them that's
+// passed with every call
+void Invocation::setLayout(PointLayoutPtr layout)
+{
+    m_dims = m_readDims.empty() ? layout->dims() : m_readDims;
+    for (Dimension::Id d : m_dims)
+        if (typeIndex(layout->dimDetail(d)->type()) == NumScalarTypes)
+            throw pdal_error("filters.julia: dimension '" +
+                layout->dimName(d) + "' has a type unsupported in Julia.");
+
+    Environment::call([this, layout]() { buildSchema(layout); });
+}
 
-    std::string wrapperModuleSrc = FileUtils::readFileIntoString(runtime_path + "/PdalJulia.jl");
-    if (wrapperModuleSrc == "") {
-        std::cerr << "Unable to find PdalJulia.jl runtime file at: " << runtime_path;
-        exit(1);
+void Invocation::buildSchema(PointLayoutPtr layout)
+{
+    const std::size_t count = m_dims.size();
+    jl_value_t* names = nullptr;
+    jl_value_t* ids = nullptr;
+    jl_value_t* types = nullptr;
+    jl_value_t* schema = nullptr;
+    JL_GC_PUSH4(&names, &ids, &types, &schema);
+
+    names = (jl_value_t*) jl_alloc_array_1d(
+        jl_apply_array_type((jl_value_t*) jl_symbol_type, 1), count);
+    ids = (jl_value_t*) jl_alloc_array_1d(
+        jl_apply_array_type((jl_value_t*) jl_int32_type, 1), count);
+    types = (jl_value_t*) jl_alloc_vec_any(count);
+
+    // Array types are held by Julia's type cache, so needn't be rooted
+    m_arrayTypes.clear();
+    m_symbols.clear();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Dimension::Id d = m_dims[i];
+        jl_datatype_t* type =
+            juliaType(typeIndex(layout->dimDetail(d)->type()));
+        jl_sym_t* name = jl_symbol(layout->dimName(d).c_str());
+
+        jl_arrayset((jl_array_t*) names, (jl_value_t*) name, i);
+        ((int32_t*) jl_array_data(ids))[i] = (int32_t) d;
+        jl_arrayset((jl_array_t*) types, (jl_value_t*) type, i);
+
+        m_arrayTypes.push_back(
+            jl_apply_array_type((jl_value_t*) type, 1));
+        m_symbols[name] = d;
+    }
+
+    schema = jl_call3(jl_get_function(m_env->wrapper(), "Schema"),
+        names, ids, types);
+    if (jl_exception_occurred() || !schema)
+    {
+        JL_GC_POP();
+        throw pdal_error("filters.julia: unable to build the schema of the "
+            "dimensions.");
     }
 
-    jl_eval_string(wrapperModuleSrc.c_str());
-    m_wrapperMod = (jl_value_t*) jl_eval_string("PdalJulia");
+    if (m_schema)
+        m_env->release(m_schema);
+    m_schema = schema;
+    m_env->retain(m_schema);
 
-    // Initialise user-supplied script
-    jl_eval_string(m_script.source());
-    jl_value_t * mod = (jl_value_t*) jl_eval_string(m_script.module());
-    m_function = jl_get_function((jl_module_t*) mod, m_script.function());
-    if (jl_exception_occurred()) {
-        std::cerr << "Julia Error in user script load: |" << jl_typeof_str(jl_exception_occurred()) << "|\n";
-        exit(1);
+    JL_GC_POP();
+
+    // The script is loaded once the schema is known, as a cached
+    // compilation of it is specific to the schema
+    if (!m_function)
+    {
+        Stopwatch sw;
+        m_function = m_env->function(m_script, m_cacheDir, m_schema);
+        m_compileTime = sw.elapsed();
     }
+}
+
+namespace
+{
 
-    // TODO: Check its callable so we fail early
+// A column of a table returned from Julia. The runtime collects any column
+// that isn't a Vector, but nothing else may be read as an array's memory.
+jl_value_t* returnedColumn(jl_array_t* table, std::size_t idx)
+{
+    jl_value_t* arr = jl_array_ptr_ref(table, idx);
+    if (!jl_is_array(arr))
+        throw pdal_error("filters.julia: function returned a column of "
+            "type " + std::string(jl_typeof_str(arr)) + ", which isn't an "
+            "array.");
+    return arr;
 }
 
-// Mapping from PDAL types to Julia array types
-jl_value_t* Invocation::determine_jl_type(const Dimension::Detail* dd) 
-{
-    const Dimension::Type type = dd->type();
-    switch (type) {
-			case Dimension::Type::Unsigned8:
-					return jl_apply_array_type((jl_value_t*) jl_uint8_type, 1);
-			case Dimension::Type::Signed8:
-					return jl_apply_array_type((jl_value_t*) jl_int8_type, 1);
-			case Dimension::Type::Unsigned16:
-					return jl_apply_array_type((jl_value_t*) jl_uint16_type, 1);
-			case Dimension::Type::Signed16:
-					return jl_apply_array_type((jl_value_t*) jl_int16_type, 1);
-			case Dimension::Type::Unsigned32:
-					return jl_apply_array_type((jl_value_t*) jl_uint32_type, 1);
-			case Dimension::Type::Signed32:
-					return jl_apply_array_type((jl_value_t*) jl_int32_type, 1);
-			case Dimension::Type::Unsigned64:
-					return jl_apply_array_type((jl_value_t*) jl_uint64_type, 1);
-			case Dimension::Type::Signed64:
-					return jl_apply_array_type((jl_value_t*) jl_int64_type, 1);
-			case Dimension::Type::Float:
-					return jl_apply_array_type((jl_value_t*) jl_float32_type, 1);
-			case Dimension::Type::Double:
-					return jl_apply_array_type((jl_value_t*) jl_float64_type, 1);
-      default:
-        std::cerr << "Unsupported type: " << type << "\n";
-        exit(1);
-    }
+} // unnamed namespace
+
+// The dimension a name returned from Julia refers to. Symbols are interned,
+// so known ones are found by address.
+Dimension::Id Invocation::dimension(jl_value_t* name, PointLayoutPtr layout)
+{
+    jl_sym_t* sym = (jl_sym_t*) name;
+    auto it = m_symbols.find(sym);
+    if (it != m_symbols.end())
+        return it->second;
+
+    const char* str = jl_symbol_name(sym);
+    Dimension::Id d = layout->findDim(str);
+    if (d == Dimension::Id::Unknown)
+        throw pdal_error("filters.julia: function returned unknown "
+            "dimension '" + std::string(str) + "'. Use "
+            "'add_dimension' to create it.");
+    m_symbols[sym] = d;
+    return d;
 }
 
-jl_array_t* Invocation::prepare_data(PointViewPtr& view)
+jl_array_t* Invocation::prepare_data(Call& call)
 {
-    PointLayoutPtr layout(view->table().layout());
-    Dimension::IdList const& dims = layout->dims();
+    ViewStorage& storage = call.m_storage;
 
     // Allocate the array of arguments as a Julia array
     jl_array_t* arg_array = jl_alloc_vec_any(0);
@@ -166,61 +292,23 @@ jl_array_t* Invocation::prepare_data(PointViewPtr& view)
     // via the arg_array root so you don't need to root it separately.
     JL_GC_PUSH1(&arg_array);
 
-		m_numDims = 0;
-    m_dimNames.clear();
-    for (auto di = dims.begin(); di != dims.end(); ++di)
+    for (std::size_t i = 0; i < call.m_columns.size(); ++i)
     {
-        Dimension::Id d = *di;
-        const Dimension::Detail *dd = layout->dimDetail(d);
-        const Dimension::Type type = dd->type();
+        const Column& column = call.m_columns[i];
 
-        m_numDims++;
-        void *data = malloc(dd->size() * view->size());
-        char *p = (char *)data;
-        for (PointId idx = 0; idx < view->size(); ++idx)
-        {
-            view->getField(p, d, type, idx);
-            p += dd->size();
-        }
-
-        // Add the array to the array of arguments
-        jl_value_t* array_type = determine_jl_type(dd);
-        jl_array_t* array_ptr = jl_ptr_to_array_1d(array_type, data, view->size(), 0);
+        // Add the array to the array of arguments. Julia doesn't own the
+        // memory: it's either the point table's or the pool's.
+        jl_array_t* array_ptr = jl_ptr_to_array_1d(m_arrayTypes[i],
+            column.m_data, storage.size(), 0);
         jl_array_ptr_1d_push(arg_array, (jl_value_t*) array_ptr);
-
-        std::string name = layout->dimName(*di);
-        m_dimNames.push_back(name);
-    }
-
-    // Allocate array for all the string data, another for pointers to the start of each string
-    char** dimNamesArray = (char **) malloc(m_dimNames.size() * sizeof(char*));
-    uint32_t full_size = 0;
-    for (uint32_t i = 0; i < m_dimNames.size(); i++) {
-        full_size += m_dimNames[i].size() * sizeof(char);
     }
 
-    // Copy dim names array into c-style string arrays
-    char* dataArray = (char *) malloc(full_size);
-    char* headPtr = dataArray;
-    for (uint32_t i = 0; i < m_dimNames.size(); i++) {
-        dimNamesArray[i] = headPtr;
-        strcpy(headPtr, m_dimNames[i].c_str());
-        headPtr += m_dimNames[i].size();
-    }
-
-    // pointers to start of string
-    jl_value_t* array_type_pointer = jl_apply_array_type((jl_value_t*) jl_voidpointer_type, 1);
-    jl_array_t* str_array = jl_ptr_to_array_1d( array_type_pointer, (void*) dimNamesArray, m_dimNames.size(), 1);
-    jl_array_ptr_1d_push(arg_array, (jl_value_t *) str_array);
-
-    // string contents
-    jl_value_t* array_type_uint8 = jl_apply_array_type((jl_value_t*) jl_uint8_type, 1);
-    jl_array_t* chr_array = jl_ptr_to_array_1d( array_type_uint8, (uint8_t*) dataArray, full_size, 1 );
-    jl_array_ptr_1d_push(arg_array, (jl_value_t *) chr_array);
+    // The names and types of the dimensions, built by setLayout()
+    jl_array_ptr_1d_push(arg_array, m_schema);
 
     // TODO: Inject this into the Julia scope as global objects
-    MetadataNode layoutMeta = view->layout()->toMetadata();
-    MetadataNode srsMeta = view->spatialReference().toMetadata();
+    // MetadataNode layoutMeta = view->layout()->toMetadata();
+    // MetadataNode srsMeta = view->spatialReference().toMetadata();
 
     // addGlobalObject(m_module, plang::fromMetadata(m_inputMetadata), "metadata");
     // addGlobalObject(m_module, getPyJSON(m_pdalargs), "pdalargs");
@@ -238,30 +326,377 @@ jl_array_t* Invocation::prepare_data(PointViewPtr& view)
     return arg_array;
 }
 
-bool Invocation::execute(PointViewPtr& view, MetadataNode stageMetadata)
+PointViewSet Invocation::execute(PointViewPtr view,
+    MetadataNode stageMetadata)
 {
-  // Get the array of arrays representing the PointCloud dimensions ready to be passed into the
-  // Julia interpreter
-  jl_array_t * julia_args = prepare_data(view);
+  if (!m_schema)
+      setLayout(view->layout());
+  const point_count_t window = windowSize(view->layout());
+  if (window && view->size() > window)
+      return executeWindows(view, window, stageMetadata);
+
+  ViewStorage storage(*view);
+  Call call(storage, m_buffers);
+  execute(call, stageMetadata);
+  return outputs(call, view);
+}
 
-  // Immediately re-protect the args array from the Julia GC
-  JL_GC_PUSH1(&julia_args);
+bool Invocation::execute(ViewStorage& storage, MetadataNode stageMetadata,
+    std::vector<PointId>& rows)
+{
+  Call call(storage, m_buffers);
+  execute(call, stageMetadata);
 
-  // Add the user-supplied function as the final argument
-  jl_array_ptr_1d_push(julia_args, (jl_value_t *) m_function);
+  rows.swap(call.m_rows);
+  return !call.m_selected;
+}
 
-  // Run the Julia runtime function "runStage" which:
-  //
-  // 1. Converts the passed in arrays into a TypedTable form
-  // 2. Passes that into the user-supplied function
-  // 3. Unpacks the returned `TypedTable` into an array of arrays of dimensions, with the final
-  //    array being the strings of the dimensions in order as they preceded it in the array
-  jl_function_t* run_stage_fn = jl_get_function((jl_module_t*) m_wrapperMod, "runStage");
-
-  jl_array_t *wrapped_pc = (jl_array_t*) jl_call1(run_stage_fn, (jl_value_t*) julia_args);
-  if (jl_exception_occurred()) {
-      std::cerr << "Julia Error in runStage: |" << jl_typeof_str(jl_exception_occurred()) << "|\n";
-      exit(1);
+// The number of points a view is split into windows of, or 0 to run it
+// whole. A memory limit allows for the columns of two windows at once, as
+// the next is gathered while the function runs, each in a buffer of the
+// pool's rounded size.
+point_count_t Invocation::windowSize(PointLayoutPtr layout) const
+{
+    point_count_t window = m_windowSize;
+    if (m_memoryLimit)
+    {
+        std::size_t pointSize = 0;
+        for (Dimension::Id d : m_dims)
+            pointSize += layout->dimSize(d);
+        auto bytes = [this, &layout](point_count_t count)
+        {
+            uint64_t total = 0;
+            for (Dimension::Id d : m_dims)
+                total += BufferPool::bucket(layout->dimSize(d) * count);
+            return 2 * total;
+        };
+
+        // The most points whose rounded buffers fit, by bisection from
+        // the most that would fit unrounded
+        point_count_t lo = 1;
+        point_count_t hi = (std::max)(m_memoryLimit / (2 * (std::max)(
+            pointSize, std::size_t(1))), uint64_t(1));
+        while (lo < hi)
+        {
+            point_count_t mid = hi - (hi - lo) / 2;
+            if (bytes(mid) <= m_memoryLimit)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        window = window ? (std::min)(window, lo) : lo;
+    }
+    return window;
+}
+
+// Run the function over windows of a view in turn, writing each back
+// before the next is run. The next window is gathered on another thread
+// while the function runs, so only two windows are copied at once.
+PointViewSet Invocation::executeWindows(PointViewPtr view,
+    point_count_t window, MetadataNode stageMetadata)
+{
+    PointViewPtr out;   // The points kept, once a window doesn't keep all
+
+    auto start = [this, &view, window](PointId first)
+    {
+        point_count_t count = (std::min)(window, view->size() - first);
+        std::unique_ptr<ViewStorage> storage(
+            new ViewStorage(*view, first, count));
+        std::unique_ptr<Call> call(new Call(*storage, m_buffers));
+        return std::make_pair(std::move(storage), std::move(call));
+    };
+    auto gathered = [this](Call *call)
+    {
+        Stopwatch sw;
+        gather(*call);
+        call->m_stats.m_marshalIn = sw.elapsed();
+    };
+
+    auto current = start(0);
+    gathered(current.second.get());
+    for (PointId first = 0; first < view->size(); first += window)
+    {
+        Call& call = *current.second;
+
+        // Gather the next window while this one runs. The windows are
+        // disjoint, so this only reads points the function isn't given.
+        decltype(current) next;
+        std::future<void> nextGathered;
+        if (first + window < view->size())
+        {
+            next = start(first + window);
+            nextGathered = std::async(std::launch::async, gathered,
+                next.second.get());
+        }
+
+        // Points added to the table for a shorter table returned could
+        // move the points being gathered, so are only added once it's done.
+        // If this throws, the future waits for the gather as it's destroyed.
+        call.m_beforeAdding = [&nextGathered]()
+        {
+            if (nextGathered.valid())
+                nextGathered.wait();
+        };
+        invoke(call);
+        record(call, stageMetadata);
+
+        // A shorter table comes back as new points, and a selection as
+        // positions in the window. Only the index of points of the view
+        // is copied.
+        if (!out && (call.m_selected || call.m_split.size()))
+        {
+            out = view->makeNew();
+            for (PointId idx = 0; idx < first; ++idx)
+                out->appendPoint(*view, idx);
+        }
+        if (call.m_split.size() > 1)
+            throw pdal_error("filters.julia: function returned several "
+                "tables, which can't be done when running a view in "
+                "windows.");
+        if (out && call.m_split.size())
+            out->append(*call.m_split.front());
+        else if (out && call.m_selected)
+            for (PointId idx : call.m_rows)
+                out->appendPoint(*view, first + idx);
+        else if (out)
+            for (PointId idx = 0; idx < call.m_storage.size(); ++idx)
+                out->appendPoint(*view, first + idx);
+
+        // The window's buffers go back to the pool for the one after next
+        if (nextGathered.valid())
+            nextGathered.get();
+        current = std::move(next);
+    }
+
+    PointViewSet views;
+    views.insert(out ? out : view);
+    return views;
+}
+
+// The views a call of the function returned. Only the index of the points
+// kept is copied, not their values.
+PointViewSet Invocation::outputs(Call& call, PointViewPtr view) const
+{
+  PointViewSet views;
+  if (call.m_split.size())
+      views.insert(call.m_split.begin(), call.m_split.end());
+  else if (call.m_selected)
+  {
+      PointViewPtr kept = view->makeNew();
+      for (PointId idx : call.m_rows)
+          kept->appendPoint(*view, idx);
+      views.insert(kept);
+  }
+  else
+      views.insert(view);
+  return views;
+}
+
+void Invocation::execute(Call& call, MetadataNode stageMetadata)
+{
+  if (!m_schema)
+      setLayout(call.m_storage.layout());
+
+  Stopwatch sw;
+  gather(call);
+  call.m_stats.m_marshalIn = sw.elapsed();
+  invoke(call);
+  record(call, stageMetadata);
+}
+
+// Run the function over the gathered columns of a call and unpack what it
+// returned
+void Invocation::invoke(Call& call)
+{
+  Stopwatch sw;
+
+  // Only the thread running Julia may call into it
+  Environment::call([&]()
+  {
+      // Get the array of arrays representing the PointCloud dimensions ready to be passed into the
+      // Julia interpreter
+      jl_array_t * julia_args = prepare_data(call);
+
+      // Immediately re-protect the args array from the Julia GC. It's kept
+      // rooted while unpacking, as it holds the columns Julia was given.
+      jl_array_t *wrapped_pc = nullptr;
+      jl_value_t *chunks = nullptr;
+      jl_value_t *index = nullptr;
+      JL_GC_PUSH4(&julia_args, &wrapped_pc, &chunks, &index);
+
+      // Add the user-supplied function as the final argument
+      jl_array_ptr_1d_push(julia_args, (jl_value_t *) m_function);
+
+      // Run the Julia runtime function "runStage" which:
+      //
+      // 1. Converts the passed in arrays into a TypedTable form
+      // 2. Passes that into the user-supplied function
+      // 3. Unpacks the returned `TypedTable` into an array of arrays of dimensions, with the final
+      //    array being the strings of the dimensions in order as they preceded it in the array
+      chunks = jl_box_int64(m_chunks);
+      index = jl_box_voidpointer(call.m_index.handle());
+      call.m_stats.m_marshalIn += sw.elapsed();
+      sw.restart();
+      wrapped_pc = (jl_array_t*) jl_call3(m_env->runStage(), (jl_value_t*) julia_args, chunks, index);
+      call.m_stats.m_function = sw.elapsed();
+      if (jl_exception_occurred())
+      {
+          std::string err =
+              Environment::errorMessage(jl_exception_occurred());
+          JL_GC_POP();
+          throw pdal_error("filters.julia: Julia error in runStage: " + err);
+      }
+
+      sw.restart();
+      try
+      {
+          unpack(call, wrapped_pc);
+      }
+      catch (...)
+      {
+          // The frame points into this stack, so must be popped before
+          // the error leaves it
+          JL_GC_POP();
+          throw;
+      }
+      call.m_stats.m_marshalOut = sw.elapsed();
+
+      // Critically important: you must pair a POP with every PUSH
+      JL_GC_POP();
+  });
+
+  // TODO: This needs to be called at the very end (not here as this is run for every point cloud view)
+  // jl_atexit_hook(0);
+}
+
+std::vector<PointViewSet> Invocation::executeParallel(
+    const std::vector<PointViewPtr>& views, MetadataNode stageMetadata)
+{
+    std::vector<std::unique_ptr<ViewStorage>> storage;
+    std::deque<Call> calls;
+    for (const PointViewPtr& view : views)
+    {
+        storage.emplace_back(new ViewStorage(*view));
+        calls.emplace_back(*storage.back(), m_buffers);
+    }
+
+    if (!m_schema && calls.size())
+        setLayout(calls[0].m_storage.layout());
+
+    // Gathering doesn't touch Julia, so the views are gathered on their
+    // own threads.
+    std::vector<std::future<void>> gathered;
+    for (Call& call : calls)
+        gathered.push_back(std::async(std::launch::async,
+            [this, &call]()
+            {
+                Stopwatch sw;
+                gather(call);
+                call.m_stats.m_marshalIn = sw.elapsed();
+            }));
+    for (std::future<void>& f : gathered)
+        f.get();
+
+    Environment::call([&]()
+    {
+        // Start a task for each view. The tasks hold their arguments, and are
+        // retained until they're fetched.
+        std::vector<jl_value_t*> tasks;
+        std::vector<Stopwatch> started;
+        auto releaseTasks = [this, &tasks](std::size_t from)
+        {
+            for (std::size_t i = from; i < tasks.size(); ++i)
+                m_env->release(tasks[i]);
+        };
+
+        for (Call& call : calls)
+        {
+            Stopwatch sw;
+            jl_array_t* julia_args = prepare_data(call);
+            jl_value_t* chunks = nullptr;
+            jl_value_t* index = nullptr;
+            JL_GC_PUSH3(&julia_args, &chunks, &index);
+            jl_array_ptr_1d_push(julia_args, (jl_value_t *) m_function);
+            chunks = jl_box_int64(m_chunks);
+            index = jl_box_voidpointer(call.m_index.handle());
+            call.m_stats.m_marshalIn += sw.elapsed();
+            started.emplace_back();
+            jl_value_t* task = jl_call3(m_env->spawnStage(),
+                (jl_value_t*) julia_args, chunks, index);
+            JL_GC_POP();
+            if (jl_exception_occurred())
+            {
+                std::string err =
+                    Environment::errorMessage(jl_exception_occurred());
+                releaseTasks(0);
+                throw pdal_error("filters.julia: unable to start Julia "
+                    "task: " + err);
+            }
+            m_env->retain(task);
+            tasks.push_back(task);
+        }
+
+        // Fetch in order, so the views are written in the order they came
+        for (std::size_t i = 0; i < tasks.size(); ++i)
+        {
+            jl_array_t* wrapped_pc =
+                (jl_array_t*) jl_call1(m_env->fetch(), tasks[i]);
+            // Time from starting the task to having its result, so includes
+            // waiting for the tasks before it
+            calls[i].m_stats.m_function = started[i].elapsed();
+            if (jl_exception_occurred())
+            {
+                std::string err =
+                    Environment::errorMessage(jl_exception_occurred());
+                releaseTasks(i);
+                throw pdal_error("filters.julia: Julia error in runStage: " +
+                    err);
+            }
+
+            // The task holds the arguments, so is released once unpacked
+            Stopwatch sw;
+            JL_GC_PUSH1(&wrapped_pc);
+            try
+            {
+                unpack(calls[i], wrapped_pc);
+            }
+            catch (...)
+            {
+                JL_GC_POP();
+                releaseTasks(i);
+                throw;
+            }
+            JL_GC_POP();
+            m_env->release(tasks[i]);
+            calls[i].m_stats.m_marshalOut = sw.elapsed();
+
+            record(calls[i], stageMetadata);
+        }
+    });
+
+    std::vector<PointViewSet> results;
+    for (std::size_t i = 0; i < views.size(); ++i)
+        results.push_back(outputs(calls[i], views[i]));
+    return results;
+}
+
+// Write the columns returned by runStage back to the points of a call
+void Invocation::unpack(Call& call, jl_array_t* wrapped_pc)
+{
+  ViewStorage& storage = call.m_storage;
+
+  // The function split the points
+  if (jl_is_tuple((jl_value_t*) wrapped_pc))
+  {
+      unpackSplit(call, (jl_value_t*) wrapped_pc);
+      return;
+  }
+
+  // The function selected the points to keep
+  if (jl_array_eltype((jl_value_t*) wrapped_pc) == jl_int64_type)
+  {
+      unpackSelection(call, wrapped_pc);
+      return;
   }
 
   //
@@ -269,114 +704,277 @@ bool Invocation::execute(PointViewPtr& view, MetadataNode stageMetadata)
   //
   assert(jl_is_array(wrapped_pc));
   assert(jl_array_eltype((jl_value_t*) wrapped_pc) == jl_any_type);
-  int num_elems = jl_array_dim0(wrapped_pc);
-  int num_dims = num_elems - 1;
+  std::size_t num_elems = jl_array_dim0(wrapped_pc);
+  std::size_t num_dims = num_elems - 1;
 
   // Unpack the list of dim names
   jl_value_t* dim_names_arr = jl_array_ptr_ref(wrapped_pc, num_elems - 1);
   assert(jl_is_array(jl_array_ptr_ref(dim_names_arr, 0)));
   assert(jl_array_dim0(dim_names_arr) == num_dims);
 
-  PointLayoutPtr layout(view->table().layout());
+  PointLayoutPtr layout(storage.layout());
+
+  // A table of a different length replaces the points, so all of their
+  // dimensions have to come back, and are all written.
+  point_count_t count = num_dims ?
+      jl_array_len(returnedColumn(wrapped_pc, 0)) : storage.size();
+  const bool resized = (count != storage.size());
+  if (resized)
+  {
+      if (count > storage.size() && !storage.canGrow())
+          throw pdal_error("filters.julia: function returned more points "
+              "than it was given, which can't be added when streaming or "
+              "running a view in windows.");
+      if (num_dims < layout->dims().size())
+          throw pdal_error("filters.julia: function returned " +
+              std::to_string(count) + " of " +
+              std::to_string(storage.size()) + " points without all "
+              "dimensions. Return every dimension, or a mask or indices "
+              "of the points to keep.");
+
+      // Other views may hold the points given, so the rows go to new
+      // points of the table.
+      if (call.m_beforeAdding)
+          call.m_beforeAdding();
+      PointViewPtr out = storage.makeNew();
+      if (out)
+      {
+          unpackNew(call, *out, wrapped_pc);
+          call.m_split.push_back(out);
+          return;
+      }
 
-  // Get each dimension (name and array of values)
-  for (int dim_index = 0; dim_index < num_dims; dim_index++) {
-      jl_value_t* arr = jl_array_ptr_ref(wrapped_pc, dim_index);
-      char* dim_name_str = (char *) jl_string_ptr(jl_array_ptr_ref(dim_names_arr, dim_index));
+      // A streamed table's points are only the stream's, so its first
+      // points hold the rows returned.
+      if (count < storage.size())
+      {
+          call.m_selected = true;
+          call.m_rows.resize(count);
+          for (PointId idx = 0; idx < count; ++idx)
+              call.m_rows[idx] = idx;
+      }
+  }
 
-      Dimension::Id d = layout->findDim(dim_name_str);
-      const Dimension::Detail *dd = layout->dimDetail(d);
+  // Get each dimension (name and array of values)
+  for (std::size_t dim_index = 0; dim_index < num_dims; dim_index++) {
+      jl_value_t* arr = returnedColumn(wrapped_pc, dim_index);
+      Dimension::Id d =
+          dimension(jl_array_ptr_ref(dim_names_arr, dim_index), layout);
+
+      if (!resized)
+      {
+          if (m_writeDims.size())
+          {
+              if (!Utils::contains(m_writeDims, d))
+                  continue;
+          }
+          else if (!is_dirty(call, arr, d))
+              continue;
+      }
 
-      unpack_array_into_pdal_view(arr, view, d);
+      unpack_array_into_pdal_view(arr, storage, layout->dimDetail(d));
+      call.m_stats.m_bytesOut +=
+          jl_array_len(arr) * layout->dimDetail(d)->size();
   }
+}
 
-  // Critically important: you must pair a POP with every PUSH
-  JL_GC_POP();
+// The function returned the (1-based) indices of the points to keep. No
+// columns come back, but those changed in place are still written.
+void Invocation::unpackSelection(Call& call, jl_array_t* indices)
+{
+    call.m_selected = true;
+    call.m_rows = selection(call, indices);
+    writeBackInPlace(call);
+}
 
-  return true;
+// The function returned a list of tables or selections, each of which
+// becomes a view.
+void Invocation::unpackSplit(Call& call, jl_value_t* parts)
+{
+    PointView *view = call.m_storage.view();
+    if (!view)
+        throw pdal_error("filters.julia: function returned several tables, "
+            "which can't be done when streaming or running a view in "
+            "windows.");
+
+    bool selected = false;
+    const std::size_t count = jl_nfields(parts);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        // Each part was unwrapped into indices or a list of columns
+        jl_value_t* value = jl_get_nth_field(parts, i);
+        jl_value_t* eltype = jl_is_array(value) ?
+            (jl_value_t*) jl_array_eltype(value) : nullptr;
+        if (eltype != (jl_value_t*) jl_int64_type &&
+                (eltype != (jl_value_t*) jl_any_type ||
+                    jl_array_len(value) == 0))
+            throw pdal_error("filters.julia: part " + std::to_string(i + 1) +
+                " of the list returned by the function is a " +
+                std::string(jl_typeof_str(value)) + ", not a table or a "
+                "selection of points.");
+
+        jl_array_t* part = (jl_array_t*) value;
+        PointViewPtr out = view->makeNew();
+        if (eltype == (jl_value_t*) jl_int64_type)
+        {
+            for (PointId idx : selection(call, part))
+                out->appendPoint(*view, idx);
+            selected = true;
+        }
+        else
+            unpackNew(call, *out, part);
+        call.m_split.push_back(out);
+    }
+    if (selected)
+        writeBackInPlace(call);
+}
 
-  // TODO: This needs to be called at the very end (not here as this is run for every point cloud view)
-  // jl_atexit_hook(0);
+// Write a table returned by the function to new points of an empty view
+void Invocation::unpackNew(Call& call, PointView& view, jl_array_t* table)
+{
+    std::size_t num_dims = jl_array_dim0(table) - 1;
+    jl_value_t* dim_names_arr = jl_array_ptr_ref(table, num_dims);
+
+    PointLayoutPtr layout(view.layout());
+    if (num_dims < layout->dims().size())
+        throw pdal_error("filters.julia: function returned a table without "
+            "all dimensions in a list. Return every dimension, or indices "
+            "of the points instead.");
+
+    for (std::size_t dim_index = 0; dim_index < num_dims; dim_index++)
+    {
+        jl_value_t* arr = returnedColumn(table, dim_index);
+        Dimension::Id d =
+            dimension(jl_array_ptr_ref(dim_names_arr, dim_index), layout);
+
+        // The first dimension adds the points, so the storage is found
+        // again for each.
+        ViewStorage storage(view);
+        unpack_array_into_pdal_view(arr, storage, layout->dimDetail(d));
+        call.m_stats.m_bytesOut +=
+            jl_array_len(arr) * layout->dimDetail(d)->size();
+    }
 }
 
-void Invocation::unpack_array_into_pdal_view(jl_value_t* arr, PointViewPtr& view, Dimension::Id d)
+// Positions of the points in a list of (1-based) indices
+std::vector<PointId> Invocation::selection(const Call& call,
+    jl_array_t* indices) const
 {
-  int num_points = jl_array_dim0(arr);
+    const point_count_t size = call.m_storage.size();
+    const int64_t *idx = (const int64_t *) jl_array_data(indices);
+    const std::size_t count = jl_array_len(indices);
 
-  if (jl_array_eltype(arr) == jl_uint8_type) {
-      uint8_t *ptr = (uint8_t *) jl_array_data(arr);
+    std::vector<PointId> rows(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (idx[i] < 1 || (point_count_t)idx[i] > size)
+            throw pdal_error("filters.julia: function selected point " +
+                std::to_string(idx[i]) + " of the " + std::to_string(size) +
+                " it was given.");
+        rows[i] = idx[i] - 1;
+    }
+    return rows;
+}
 
-      for (PointId idx = 0; idx < num_points; ++idx) {
-          view->setField(d, idx, ptr[idx]);
-      }
-  }
-  else if (jl_array_eltype(arr) == jl_int8_type) {
-      int8_t *ptr = (int8_t *) jl_array_data(arr);
+// Write back gathered columns the function changed in place, when it
+// didn't return them.
+void Invocation::writeBackInPlace(Call& call)
+{
+    // Shared columns are already up to date
+    if (m_dirtyCheck == DirtyCheck::Identity)
+        return;
 
-      for (PointId idx = 0; idx < num_points; ++idx) {
-          view->setField(d, idx, ptr[idx]);
-      }
-  }
-  else if (jl_array_eltype(arr) == jl_uint16_type) {
-      uint16_t *ptr = (uint16_t *) jl_array_data(arr);
+    ViewStorage& storage = call.m_storage;
+    PointLayoutPtr layout(storage.layout());
+    for (const Column& column : call.m_columns)
+    {
+        if (column.m_shared)
+            continue;
+        if (m_writeDims.size() && !Utils::contains(m_writeDims, column.m_id))
+            continue;
+
+        const Dimension::Detail *dd = layout->dimDetail(column.m_id);
+        const std::size_t size = dd->size() * storage.size();
+        if (m_dirtyCheck == DirtyCheck::Checksum &&
+                checksum(column.m_data, size) == column.m_checksum)
+            continue;
+
+        storage.scatter(dd, dd->type(), (const char *)column.m_data,
+            storage.size());
+        call.m_stats.m_bytesOut += size;
+    }
+}
 
-      for (PointId idx = 0; idx < num_points; ++idx) {
-          view->setField(d, idx, ptr[idx]);
-      }
-  }
-  else if (jl_array_eltype(arr) == jl_int16_type) {
-      int16_t *ptr = (int16_t *) jl_array_data(arr);
+// Add the stats of a call to the totals and, if there's a node for them,
+// the stage's metadata
+void Invocation::record(const Call& call, MetadataNode stageMetadata)
+{
+    // The first call also compiles runStage and the user function
+    if (m_calls++ == 0)
+        m_firstCall = call.m_stats.m_function;
+    m_totals += call.m_stats;
 
-      for (PointId idx = 0; idx < num_points; ++idx) {
-          view->setField(d, idx, ptr[idx]);
-      }
-  }
-  else if (jl_array_eltype(arr) == jl_uint32_type) {
-      uint32_t *ptr = (uint32_t *) jl_array_data(arr);
+    if (stageMetadata.valid())
+        addStats(timingsNode(stageMetadata).add("view"), call.m_stats);
+}
 
-      for (PointId idx = 0; idx < num_points; ++idx) {
-          view->setField(d, idx, ptr[idx]);
-      }
-  }
-  else if (jl_array_eltype(arr) == jl_int32_type) {
-      int32_t *ptr = (int32_t *) jl_array_data(arr);
+void Invocation::addTimings(MetadataNode stageMetadata) const
+{
+    MetadataNode n = timingsNode(stageMetadata);
+    if (m_startedJulia)
+        addTiming(n, "julia_start", m_startTime);
+    addTiming(n, "compile", m_compileTime);
+    addTiming(n, "warm_up", m_warmUpTime);
+    addTiming(n, "first_call", m_firstCall);
+    n.add("calls", m_calls);
+    addStats(n.add("total"), m_totals);
+}
 
-      for (PointId idx = 0; idx < num_points; ++idx) {
-          view->setField(d, idx, ptr[idx]);
-      }
-  }
-  else if (jl_array_eltype(arr) == jl_uint64_type) {
-      uint64_t *ptr = (uint64_t *) jl_array_data(arr);
+// Whether a column returned from Julia differs from what is in the view
+bool Invocation::is_dirty(const Call& call, jl_value_t* arr,
+    Dimension::Id d) const
+{
+    if (m_dirtyCheck == DirtyCheck::None)
+        return true;
 
-      for (PointId idx = 0; idx < num_points; ++idx) {
-          view->setField(d, idx, ptr[idx]);
-      }
-  }
-  else if (jl_array_eltype(arr) == jl_int64_type) {
-      int64_t *ptr = (int64_t *) jl_array_data(arr);
+    for (const Column& column : call.m_columns)
+    {
+        if (column.m_id != d)
+            continue;
 
-      for (PointId idx = 0; idx < num_points; ++idx) {
-          view->setField(d, idx, ptr[idx]);
-      }
-  }
-  else if (jl_array_eltype(arr) == jl_float32_type) {
-      float *ptr = (float *) jl_array_data(arr);
+        // A new array always needs writing back
+        if (jl_array_data(arr) != column.m_data)
+            return true;
 
-      for (PointId idx = 0; idx < num_points; ++idx) {
-          view->setField(d, idx, ptr[idx]);
-      }
-  }
-  else if (jl_array_eltype(arr) == jl_float64_type) {
-      double *ptr = (double *) jl_array_data(arr);
+        // The point table's own memory is already up to date
+        if (column.m_shared || m_dirtyCheck == DirtyCheck::Identity)
+            return false;
 
-      for (PointId idx = 0; idx < num_points; ++idx) {
-          view->setField(d, idx, ptr[idx]);
-      }
-  }
-  else {
-    std::cerr << "Unsupported type returned from Julia" << "\n";
-    exit(1);
-  }
+        std::size_t size = jl_array_len(arr) * ((jl_array_t*)arr)->elsize;
+        return checksum(column.m_data, size) != column.m_checksum;
+    }
+
+    // Not passed in, so it's been computed by the function
+    return true;
+}
+
+void Invocation::unpack_array_into_pdal_view(jl_value_t* arr,
+    ViewStorage& storage, const Dimension::Detail* dd)
+{
+    if (!jl_is_array(arr))
+        throw pdal_error("filters.julia: function returned a " +
+            std::string(jl_typeof_str(arr)) + " for dimension '" +
+            storage.layout()->dimName(dd->id()) + "', which isn't an "
+            "array.");
+
+    std::size_t type = typeIndex((jl_value_t*) jl_array_eltype(arr));
+    if (type == NumScalarTypes)
+        throw pdal_error("filters.julia: unsupported type returned from Julia "
+            "for dimension '" + storage.layout()->dimName(dd->id()) +
+            "'.");
+
+    storage.scatter(dd, pdalType(type), (const char *)jl_array_data(arr),
+        jl_array_len(arr));
 }
 
 } // namespace jlang
@@ -37,11 +37,19 @@
 #include <julia.h>
 #include <pdal/pdal_internal.hpp>
 
+#include "BufferPool.hpp"
+#include "Environment.hpp"
+#include "PointIndex.hpp"
 #include "Script.hpp"
+#include "Stopwatch.hpp"
+#include "ViewStorage.hpp"
 
 #include <pdal/Dimension.hpp>
 #include <pdal/PointView.hpp>
 
+#include <functional>
+#include <map>
+
 namespace pdal
 {
 namespace jlang
@@ -50,28 +58,214 @@ namespace jlang
 class PDAL_DLL Invocation
 {
 public:
-    Invocation(const Script&, MetadataNode m, const std::string& pdalArgs);
+    // How to decide whether a column returned by Julia needs writing back.
+    enum class DirtyCheck
+    {
+        None,       // Write back every column
+        Identity,   // Skip columns that are the array Julia was given
+        Checksum    // As Identity, unless the array was modified in place
+    };
+
+    // What one or more calls of the function took
+    struct Stats
+    {
+        Stats() : m_points(0), m_bytesIn(0), m_bytesOut(0)
+        {}
+
+        Stats& operator+=(const Stats& other);
+
+        Timing m_marshalIn;     // Gathering and wrapping the columns
+        Timing m_function;      // runStage, including the user function
+        Timing m_marshalOut;    // Writing changed columns back
+        point_count_t m_points;
+        uint64_t m_bytesIn;     // Copied into Julia
+        uint64_t m_bytesOut;    // Copied back to the point table
+    };
+
+    Invocation(const Script&, MetadataNode m, const std::string& pdalArgs,
+        int threads = 0);
     Invocation& operator=(Invocation const& rhs) = delete;
     Invocation(const Invocation& other) = delete;
-    ~Invocation()
-    {}
+    ~Invocation();
+
+    // Run the function over a view. Returns the views of the points it
+    // returned: v itself, a view of the points it kept, or a view for each
+    // table or selection in a list it returned.
+    PointViewSet execute(PointViewPtr v, MetadataNode stageMetadata);
+
+    // Run the function over a set of points. If it keeps only some of them,
+    // returns false and sets rows to the positions of those kept.
+    bool execute(ViewStorage& storage, MetadataNode stageMetadata,
+        std::vector<PointId>& rows);
+
+    // Run the function over each view as a task on Julia's thread pool.
+    // The views are marshalled concurrently and the results are written
+    // back in the order of the views. Returns the views of each, as
+    // execute() does.
+    std::vector<PointViewSet> executeParallel(
+        const std::vector<PointViewPtr>& views, MetadataNode stageMetadata);
+
+    // Restrict the dimensions passed to Julia. An empty list passes all.
+    void setReadDims(const Dimension::IdList& dims)
+    {
+        m_readDims = dims;
+    }
+
+    // Fix the dimensions passed to Julia, after any setReadDims(), and
+    // send their schema. The first call does this if it isn't done before.
+    void setLayout(PointLayoutPtr layout);
+
+    // Restrict the dimensions written back from Julia. An empty list
+    // writes back all modified dimensions.
+    void setWriteDims(const Dimension::IdList& dims)
+    {
+        m_writeDims = dims;
+    }
+
+    void setDirtyCheck(DirtyCheck check)
+    {
+        m_dirtyCheck = check;
+    }
 
-    bool execute(PointViewPtr& v, MetadataNode stageMetadata);
+    // Run views of more than this many points in windows of it, each
+    // written back before the next is run. 0 runs views whole.
+    void setWindowSize(point_count_t points)
+    {
+        m_windowSize = points;
+    }
+
+    // Limit the columns copied for a view to about this many bytes, by
+    // running it in windows, and the buffers kept for reuse to as many. 0 is
+    // no limit.
+    void setMemoryLimit(uint64_t bytes)
+    {
+        m_memoryLimit = bytes;
+        if (bytes)
+            m_buffers.setLimit(bytes);
+    }
+
+    // Load the script from a package precompiled in this directory, and
+    // compile it there if it isn't. Must be set before setLayout().
+    void setCacheDir(const std::string& dir)
+    {
+        m_cacheDir = dir;
+    }
+
+    // Split each call into this many row-chunks, run on Julia's threads.
+    // 0 uses a chunk per thread.
+    void setChunks(int chunks)
+    {
+        m_chunks = chunks;
+    }
+
+    // Compile the function for the schema now, rather than in the first
+    // call, once setLayout() has been called.
+    void warmUp();
+
+    // What every call so far took
+    const Stats& totals() const
+    {
+        return m_totals;
+    }
+
+    // Add the time taken starting Julia, compiling the script and the
+    // first call, and the totals of every call so far.
+    void addTimings(MetadataNode stageMetadata) const;
+
+    // The "timings" node of a stage's metadata, and the entries under it,
+    // which DaemonClient reports too
+    static MetadataNode timingsNode(MetadataNode stageMetadata);
+    static void addTiming(MetadataNode parent, const std::string& name,
+        const Timing& t);
+    static void addStats(MetadataNode n, const Stats& stats);
 
     jl_function_t* m_function;
-    jl_value_t* m_wrapperMod;
 
 private:
-    void initialise();
-    void compile();
-    jl_array_t* prepare_data(PointViewPtr& view);
-    jl_value_t* determine_jl_type(const Dimension::Detail* dd);
-    void unpack_array_into_pdal_view(jl_value_t* arr, PointViewPtr& view, Dimension::Id d);
+    // A dimension as it was handed to Julia
+    struct Column
+    {
+        Dimension::Id m_id;
+        void *m_data;
+        std::size_t m_bytes;
+        bool m_shared;          // m_data is the point table's own memory
+        uint64_t m_checksum;
+    };
+
+    // The points of one call of the function, and their columns. Copied
+    // columns go back to the pool when the call is done with.
+    struct Call
+    {
+        Call(ViewStorage& storage, BufferPool& pool) :
+            m_storage(storage), m_pool(pool), m_selected(false),
+            m_index(storage.view())
+        {}
+        ~Call()
+        {
+            for (const Column& column : m_columns)
+                if (!column.m_shared)
+                    m_pool.release((char *)column.m_data, column.m_bytes);
+        }
+        Call& operator=(const Call&) = delete;
+        Call(const Call&) = delete;
+
+        ViewStorage& m_storage;
+        BufferPool& m_pool;
+        std::vector<Column> m_columns;
+        bool m_selected;                // Only some points were kept
+        std::vector<PointId> m_rows;    // Positions of the points kept
+        std::vector<PointViewPtr> m_split;  // Views of a list returned
+        std::function<void()> m_beforeAdding;   // Run before adding points
+        Stats m_stats;
+        PointIndex m_index;     // Of the view, for queries from Julia
+    };
 
+    void buildSchema(PointLayoutPtr layout);
+    Dimension::Id dimension(jl_value_t* name, PointLayoutPtr layout);
+    void execute(Call& call, MetadataNode stageMetadata);
+    void invoke(Call& call);
+    point_count_t windowSize(PointLayoutPtr layout) const;
+    PointViewSet executeWindows(PointViewPtr view, point_count_t window,
+        MetadataNode stageMetadata);
+    PointViewSet outputs(Call& call, PointViewPtr view) const;
+    void gather(Call& call) const;
+    jl_array_t* prepare_data(Call& call);
+    void unpack(Call& call, jl_array_t* result);
+    void unpackSelection(Call& call, jl_array_t* indices);
+    void unpackSplit(Call& call, jl_value_t* parts);
+    void unpackNew(Call& call, PointView& view, jl_array_t* table);
+    std::vector<PointId> selection(const Call& call,
+        jl_array_t* indices) const;
+    void writeBackInPlace(Call& call);
+    void unpack_array_into_pdal_view(jl_value_t* arr, ViewStorage& storage,
+        const Dimension::Detail* dd);
+    bool is_dirty(const Call& call, jl_value_t* arr, Dimension::Id d) const;
+    void record(const Call& call, MetadataNode stageMetadata);
+
+    EnvironmentPtr m_env;
     Script m_script;
 
-    std::vector<std::string> m_dimNames;
-    int32_t m_numDims;
+    Dimension::IdList m_dims;               // Passed to Julia
+    jl_value_t* m_schema;                   // PdalJulia.Schema of m_dims
+    std::vector<jl_value_t*> m_arrayTypes;  // Julia array type of each
+    std::map<jl_sym_t*, Dimension::Id> m_symbols;
+    BufferPool m_buffers;
+
+    Dimension::IdList m_readDims;
+    Dimension::IdList m_writeDims;
+    DirtyCheck m_dirtyCheck;
+    int m_chunks;
+    point_count_t m_windowSize;
+    uint64_t m_memoryLimit;
+    std::string m_cacheDir;
+
+    bool m_startedJulia;                    // This stage started the runtime
+    Timing m_startTime;
+    Timing m_compileTime;
+    Timing m_warmUpTime;
+    Timing m_firstCall;
+    std::size_t m_calls;
+    Stats m_totals;
 
     MetadataNode m_inputMetadata;
     std::string m_pdalargs;
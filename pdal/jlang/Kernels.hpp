@@ -0,0 +1,345 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#pragma once
+
+#include <julia.h>
+#include <pdal/pdal_internal.hpp>
+
+#include <pdal/Dimension.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace pdal
+{
+namespace jlang
+{
+
+// A run of values of one dimension, m_stride bytes apart
+struct Span
+{
+    char *m_data;
+    std::ptrdiff_t m_stride;
+    point_count_t m_count;
+};
+
+// Copies count values between two strided buffers, converting the type
+typedef void (*TransferFn)(const char *src, std::ptrdiff_t srcStride,
+    char *dst, std::ptrdiff_t dstStride, point_count_t count);
+
+// The scalar types exchanged with Julia, in the order of the kernel table:
+// X(C++ type, Dimension::Type, Julia type)
+#define JLANG_SCALAR_TYPES(X) \
+    X(uint8_t, Unsigned8, jl_uint8_type) \
+    X(int8_t, Signed8, jl_int8_type) \
+    X(uint16_t, Unsigned16, jl_uint16_type) \
+    X(int16_t, Signed16, jl_int16_type) \
+    X(uint32_t, Unsigned32, jl_uint32_type) \
+    X(int32_t, Signed32, jl_int32_type) \
+    X(uint64_t, Unsigned64, jl_uint64_type) \
+    X(int64_t, Signed64, jl_int64_type) \
+    X(float, Float, jl_float32_type) \
+    X(double, Double, jl_float64_type)
+
+const std::size_t NumScalarTypes = 10;
+
+namespace kernel
+{
+
+// Whether every value of Src can be stored in Dst, so converting needs no
+// check. Integers are taken to fit in any floating point type.
+template<typename Src, typename Dst>
+struct Widening : std::integral_constant<bool,
+    std::is_floating_point<Dst>::value ?
+        (std::is_integral<Src>::value || sizeof(Dst) >= sizeof(Src)) :
+        (std::is_integral<Src>::value &&
+            (std::is_signed<Src>::value == std::is_signed<Dst>::value ?
+                sizeof(Dst) >= sizeof(Src) :
+                std::is_signed<Dst>::value && sizeof(Dst) > sizeof(Src)))>
+{};
+
+struct FloatToInt {};
+struct FloatToFloat {};
+struct IntToInt {};
+struct IntToFloat {};
+
+template<typename Src, typename Dst>
+using Conversion = typename std::conditional<
+    std::is_floating_point<Src>::value,
+    typename std::conditional<std::is_integral<Dst>::value,
+        FloatToInt, FloatToFloat>::type,
+    typename std::conditional<std::is_integral<Dst>::value,
+        IntToInt, IntToFloat>::type>::type;
+
+// The value rounded, as PDAL does in setField(), isn't NaN and is in range
+template<typename Src, typename Dst>
+inline bool inRange(Src v, FloatToInt)
+{
+    const double r = std::round((double)v);
+    return r >= (double)std::numeric_limits<Dst>::lowest() &&
+        r < (double)std::numeric_limits<Dst>::max() + 1.0;
+}
+
+// Infinities and NaN carry over, but not finite values too large
+template<typename Src, typename Dst>
+inline bool inRange(Src v, FloatToFloat)
+{
+    return !std::isfinite(v) ||
+        (v >= std::numeric_limits<Dst>::lowest() &&
+            v <= std::numeric_limits<Dst>::max());
+}
+
+template<typename Src>
+inline bool negative(Src v, std::true_type)
+{
+    return v < 0;
+}
+
+template<typename Src>
+inline bool negative(Src, std::false_type)
+{
+    return false;
+}
+
+template<typename Src, typename Dst>
+inline bool inRange(Src v, IntToInt)
+{
+    if (negative(v, std::is_signed<Src>()))
+        return std::is_signed<Dst>::value &&
+            (intmax_t)v >= (intmax_t)std::numeric_limits<Dst>::lowest();
+    return (uintmax_t)v <= (uintmax_t)std::numeric_limits<Dst>::max();
+}
+
+template<typename Src, typename Dst>
+inline bool inRange(Src, IntToFloat)
+{
+    return true;
+}
+
+template<typename Src, typename Dst>
+inline Dst cast(Src v, FloatToInt)
+{
+    return static_cast<Dst>(std::round(v));
+}
+
+template<typename Src, typename Dst, typename C>
+inline Dst cast(Src v, C)
+{
+    return static_cast<Dst>(v);
+}
+
+// Floating point values stored in integer dimensions are rounded, as PDAL
+// does in setField(), and values that don't fit throw, as they do there.
+// Widening conversions are never checked, so their loops still vectorise.
+template<typename Src, typename Dst>
+inline Dst convert(Src v)
+{
+    if (!Widening<Src, Dst>::value &&
+            !inRange<Src, Dst>(v, Conversion<Src, Dst>()))
+        throw pdal_error("value " + std::to_string(+v) + " is out of range");
+    return cast<Src, Dst>(v, Conversion<Src, Dst>());
+}
+
+template<typename Src, typename Dst>
+void transfer(const char *src, std::ptrdiff_t srcStride, char *dst,
+    std::ptrdiff_t dstStride, point_count_t count)
+{
+    if (srcStride == sizeof(Src) && dstStride == sizeof(Dst))
+    {
+        if (std::is_same<Src, Dst>::value)
+        {
+            std::memcpy(dst, src, count * sizeof(Src));
+            return;
+        }
+
+        // Both sides are packed, so this loop vectorises
+        const Src *in = reinterpret_cast<const Src *>(src);
+        Dst *out = reinterpret_cast<Dst *>(dst);
+        for (point_count_t i = 0; i < count; ++i)
+            out[i] = convert<Src, Dst>(in[i]);
+        return;
+    }
+
+    for (point_count_t i = 0; i < count; ++i)
+    {
+        Src in;
+        std::memcpy(&in, src, sizeof(Src));
+        Dst out = convert<Src, Dst>(in);
+        std::memcpy(dst, &out, sizeof(Dst));
+        src += srcStride;
+        dst += dstStride;
+    }
+}
+
+template<typename Src>
+struct KernelRow
+{
+    static TransferFn get(std::size_t dst)
+    {
+#define JLANG_KERNEL(T, D, J) &transfer<Src, T>,
+        static const TransferFn row[NumScalarTypes] =
+            { JLANG_SCALAR_TYPES(JLANG_KERNEL) };
+#undef JLANG_KERNEL
+        return row[dst];
+    }
+};
+
+} // namespace kernel
+
+// Index of a PDAL type in the kernel table, NumScalarTypes if unsupported
+inline std::size_t typeIndex(Dimension::Type type)
+{
+#define JLANG_DIM_TYPE(T, D, J) Dimension::Type::D,
+    static const Dimension::Type types[NumScalarTypes] =
+        { JLANG_SCALAR_TYPES(JLANG_DIM_TYPE) };
+#undef JLANG_DIM_TYPE
+    for (std::size_t i = 0; i < NumScalarTypes; ++i)
+        if (types[i] == type)
+            return i;
+    return NumScalarTypes;
+}
+
+// Index of a Julia element type in the kernel table, NumScalarTypes if
+// unsupported. The Julia types only exist once the runtime is initialised,
+// so they can't be held in a static table.
+inline std::size_t typeIndex(jl_value_t *type)
+{
+#define JLANG_JL_TYPE(T, D, J) J,
+    jl_datatype_t *types[NumScalarTypes] =
+        { JLANG_SCALAR_TYPES(JLANG_JL_TYPE) };
+#undef JLANG_JL_TYPE
+    for (std::size_t i = 0; i < NumScalarTypes; ++i)
+        if ((jl_value_t *)types[i] == type)
+            return i;
+    return NumScalarTypes;
+}
+
+// Index of a C++ type in the kernel table, NumScalarTypes if unsupported
+template<typename T>
+inline std::size_t typeIndex()
+{
+    std::size_t i = 0;
+#define JLANG_CXX_TYPE(C, D, J) \
+    if (std::is_same<T, C>::value) \
+        return i; \
+    ++i;
+    JLANG_SCALAR_TYPES(JLANG_CXX_TYPE)
+#undef JLANG_CXX_TYPE
+    return i;
+}
+
+inline Dimension::Type pdalType(std::size_t index)
+{
+#define JLANG_DIM_TYPE(T, D, J) Dimension::Type::D,
+    static const Dimension::Type types[NumScalarTypes] =
+        { JLANG_SCALAR_TYPES(JLANG_DIM_TYPE) };
+#undef JLANG_DIM_TYPE
+    return types[index];
+}
+
+inline jl_datatype_t *juliaType(std::size_t index)
+{
+#define JLANG_JL_TYPE(T, D, J) J,
+    jl_datatype_t *types[NumScalarTypes] =
+        { JLANG_SCALAR_TYPES(JLANG_JL_TYPE) };
+#undef JLANG_JL_TYPE
+    return types[index];
+}
+
+// The kernel converting values of type index src to type index dst
+inline TransferFn transferKernel(std::size_t src, std::size_t dst)
+{
+#define JLANG_ROW(T, D, J) &kernel::KernelRow<T>::get,
+    static TransferFn (* const rows[NumScalarTypes])(std::size_t) =
+        { JLANG_SCALAR_TYPES(JLANG_ROW) };
+#undef JLANG_ROW
+    return rows[src](dst);
+}
+
+// Copies values from a list of spans into a packed buffer
+inline void gather(const std::vector<Span>& spans, TransferFn fn,
+    char *dst, std::size_t dstSize)
+{
+    for (const Span& s : spans)
+    {
+        fn(s.m_data, s.m_stride, dst, dstSize, s.m_count);
+        dst += s.m_count * dstSize;
+    }
+}
+
+// Copies values from a packed buffer into a list of spans, stopping after
+// count values
+inline void scatter(const char *src, std::size_t srcSize, TransferFn fn,
+    const std::vector<Span>& spans, point_count_t count)
+{
+    for (const Span& s : spans)
+    {
+        if (count == 0)
+            break;
+        point_count_t n = (std::min)(count, s.m_count);
+        fn(src, srcSize, s.m_data, s.m_stride, n);
+        src += n * srcSize;
+        count -= n;
+    }
+}
+
+// Cheap 64-bit checksum of a buffer, used to spot columns that Julia
+// modified in place.
+inline uint64_t checksum(const void *data, std::size_t size)
+{
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    const char *p = (const char *)data;
+    std::size_t words = size / sizeof(uint64_t);
+    for (std::size_t i = 0; i < words; ++i)
+    {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        hash = (hash ^ word) * prime;
+        p += sizeof(word);
+    }
+    for (std::size_t i = words * sizeof(uint64_t); i < size; ++i)
+        hash = (hash ^ (uint8_t)*p++) * prime;
+    return hash;
+}
+
+} // namespace jlang
+} // namespace pdal
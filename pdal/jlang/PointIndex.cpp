@@ -0,0 +1,154 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#include "PointIndex.hpp"
+
+#include <pdal/KDIndex.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace pdal
+{
+namespace jlang
+{
+
+PointIndex::PointIndex(PointView *view) : m_view(view)
+{}
+
+
+PointIndex::~PointIndex()
+{}
+
+
+const KD2Index& PointIndex::index2d()
+{
+    std::call_once(m_built2d, [this]()
+    {
+        m_2d.reset(new KD2Index(*m_view));
+        m_2d->build();
+    });
+    return *m_2d;
+}
+
+
+const KD3Index& PointIndex::index3d()
+{
+    std::call_once(m_built3d, [this]()
+    {
+        m_3d.reset(new KD3Index(*m_view));
+        m_3d->build();
+    });
+    return *m_3d;
+}
+
+
+void PointIndex::setError(const std::string& msg)
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    m_error = msg;
+}
+
+
+std::size_t PointIndex::error(void *handle, char *msg, std::size_t size)
+{
+    PointIndex *index = (PointIndex *)handle;
+    std::lock_guard<std::mutex> lock(index->m_errorMutex);
+    std::memcpy(msg, index->m_error.data(),
+        (std::min)(size, index->m_error.size()));
+    return index->m_error.size();
+}
+
+
+std::size_t PointIndex::radius(void *handle, std::size_t dims,
+    const double *x, const double *y, const double *z, std::size_t n,
+    double r, int64_t *counts, int64_t *ids, std::size_t capacity)
+{
+    PointIndex *index = (PointIndex *)handle;
+    try
+    {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            PointIdList found = (dims == 2) ?
+                index->index2d().radius(x[i], y[i], r) :
+                index->index3d().radius(x[i], y[i], z[i], r);
+            counts[i] = (int64_t)found.size();
+            for (PointId id : found)
+            {
+                if (total < capacity)
+                    ids[total] = (int64_t)id + 1;
+                ++total;
+            }
+        }
+        return total;
+    }
+    catch (const std::exception& err)
+    {
+        index->setError(err.what());
+        return Failed;
+    }
+}
+
+
+std::size_t PointIndex::knn(void *handle, std::size_t dims,
+    const double *x, const double *y, const double *z, std::size_t n,
+    std::size_t k, int64_t *ids)
+{
+    PointIndex *index = (PointIndex *)handle;
+    try
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            PointIdList found = (dims == 2) ?
+                index->index2d().neighbors(x[i], y[i], k) :
+                index->index3d().neighbors(x[i], y[i], z[i], k);
+            found.resize((std::min)(found.size(), k));
+
+            int64_t *out = ids + i * k;
+            for (std::size_t j = 0; j < found.size(); ++j)
+                out[j] = (int64_t)found[j] + 1;
+            std::fill(out + found.size(), out + k, 0);
+        }
+        return n;
+    }
+    catch (const std::exception& err)
+    {
+        index->setError(err.what());
+        return Failed;
+    }
+}
+
+} // namespace jlang
+} // namespace pdal
@@ -0,0 +1,116 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#pragma once
+
+#include <pdal/pdal_internal.hpp>
+
+#include <pdal/PointView.hpp>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace pdal
+{
+
+class KD2Index;
+class KD3Index;
+
+namespace jlang
+{
+
+// PDAL's KD indexes of the view a call of the function is for, queried by
+// the PdalJulia runtime's radius and knn through the callbacks below. Each
+// index is built for the call the first time it's queried, rather than
+// taken from the view, whose cached index isn't rebuilt when a stage moves
+// the points.
+//
+// The callbacks are run on Julia's threads, possibly several at once, and
+// must not throw into Julia: an error is returned as Failed instead, and
+// its message is kept for error().
+class PDAL_DLL PointIndex
+{
+public:
+    PointIndex(PointView *view);
+    ~PointIndex();
+
+    PointIndex& operator=(const PointIndex&) = delete;
+    PointIndex(const PointIndex&) = delete;
+
+    // The handle passed to Julia, or null if there's no view to index, as
+    // when streaming or running a view in windows
+    void *handle()
+    {
+        return m_view ? this : nullptr;
+    }
+
+    static const std::size_t Failed = (std::size_t)-1;
+
+    // Find the points within r of each of n points, with coordinates in x
+    // and y, and z if dims is 3. counts is set to the number found for
+    // each, and the (1-based) indices of them are written one after
+    // another to ids, up to capacity of them. Returns the total found.
+    static std::size_t radius(void *handle, std::size_t dims,
+        const double *x, const double *y, const double *z, std::size_t n,
+        double r, int64_t *counts, int64_t *ids, std::size_t capacity);
+
+    // Write the (1-based) indices of the k nearest points to each of n
+    // points to ids, k to a point, padded with 0 when the view has fewer.
+    // Returns n.
+    static std::size_t knn(void *handle, std::size_t dims, const double *x,
+        const double *y, const double *z, std::size_t n, std::size_t k,
+        int64_t *ids);
+
+    // Copy the message of the last query that failed to msg, up to size
+    // bytes. Returns its length.
+    static std::size_t error(void *handle, char *msg, std::size_t size);
+
+private:
+    const KD2Index& index2d();
+    const KD3Index& index3d();
+    void setError(const std::string& msg);
+
+    PointView *m_view;
+    std::once_flag m_built2d;
+    std::once_flag m_built3d;
+    std::unique_ptr<KD2Index> m_2d;
+    std::unique_ptr<KD3Index> m_3d;
+
+    std::mutex m_errorMutex;
+    std::string m_error;
+};
+
+} // namespace jlang
+} // namespace pdal
@@ -34,6 +34,9 @@
 
 #include "../jlang/Script.hpp"
 
+#include <cctype>
+#include <regex>
+
 #pragma warning(disable: 4127) // conditional expression is constant
 
 namespace pdal
@@ -51,6 +54,121 @@ Script::Script( const std::string& source,
 }
 
 
+namespace
+{
+
+// The source with its comments blanked out. String and character literals
+// are kept, as a name in a string may be a lookup such as Symbol("X").
+std::string stripComments(const std::string& src)
+{
+    std::string out(src);
+    std::size_t i = 0;
+    auto identChar = [](char c)
+        { return std::isalnum((unsigned char)c) || c == '_' || c == '!'; };
+    while (i < out.size())
+    {
+        char c = out[i];
+        if (c == '"' || (c == '\'' && (i == 0 ||
+            !(identChar(out[i - 1]) || out[i - 1] == ')' ||
+              out[i - 1] == ']' || out[i - 1] == '\''))))
+        {
+            // Skip the literal. A quote after an identifier or bracket is
+            // Julia's adjoint operator rather than a character literal.
+            const bool triple = c == '"' && out.compare(i, 3, "\"\"\"") == 0;
+            i += triple ? 3 : 1;
+            while (i < out.size())
+            {
+                if (out[i] == '\\')
+                    i += 2;
+                else if (triple ? out.compare(i, 3, "\"\"\"") == 0 :
+                        out[i] == c)
+                {
+                    i += triple ? 3 : 1;
+                    break;
+                }
+                else
+                    ++i;
+            }
+        }
+        else if (c == '#' && i + 1 < out.size() && out[i + 1] == '=')
+        {
+            // Block comments nest
+            int depth = 0;
+            while (i < out.size())
+            {
+                if (out.compare(i, 2, "#=") == 0)
+                {
+                    ++depth;
+                    out[i++] = ' ';
+                    out[i++] = ' ';
+                }
+                else if (out.compare(i, 2, "=#") == 0)
+                {
+                    out[i++] = ' ';
+                    out[i++] = ' ';
+                    if (--depth == 0)
+                        break;
+                }
+                else
+                {
+                    if (out[i] != '\n')
+                        out[i] = ' ';
+                    ++i;
+                }
+            }
+        }
+        else if (c == '#')
+        {
+            while (i < out.size() && out[i] != '\n')
+                out[i++] = ' ';
+        }
+        else
+            ++i;
+    }
+    return out;
+}
+
+std::string escapeRegex(const std::string& s)
+{
+    static const std::string special("\\^$.|?*+()[]{}");
+    std::string out;
+    for (char c : s)
+    {
+        if (special.find(c) != std::string::npos)
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+} // unnamed namespace
+
+
+StringList Script::referencedDims(const StringList& candidates) const
+{
+    const std::string code = stripComments(m_source);
+
+    // Code that reaches columns other than by writing their names, such as
+    // by reflection, iterating a row or building a Symbol, can touch any
+    // dimension, as can code loaded from elsewhere, so all are passed.
+    static const std::regex dynamic("\\b(columnnames|columns|propertynames|"
+        "getproperty|getfield|fieldnames|keys|values|pairs|Symbol|eval|"
+        "include|Tables)\\b|@eval|:\\$");
+    if (std::regex_search(code, dynamic))
+        return candidates;
+
+    StringList dims;
+    for (const std::string& name : candidates)
+    {
+        std::regex identifier("(^|[^A-Za-z0-9_])" + escapeRegex(name) +
+            "($|[^A-Za-z0-9_!])");
+        if (std::regex_search(code, identifier))
+            dims.push_back(name);
+    }
+    return dims;
+}
+
+
 std::ostream& operator << (std::ostream& os, Script const& script)
 {
     os << "source=[" << strlen(script.source()) << " bytes], ";
@@ -63,6 +63,12 @@ public:
         return m_function.c_str();
     }
 
+    // Returns the subset of the candidate dimension names that the source
+    // names outside comments, or all of them when it may reach columns some
+    // other way, such as by reflection or a Symbol built at run time. This
+    // is a textual check, not an analysis of the code.
+    StringList referencedDims(const StringList& candidates) const;
+
 private:
     std::string m_source;
     std::string m_module;
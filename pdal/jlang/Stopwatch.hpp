@@ -0,0 +1,94 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#pragma once
+
+#include <pdal/pdal_internal.hpp>
+
+#include <chrono>
+#include <ctime>
+
+namespace pdal
+{
+namespace jlang
+{
+
+// Time spent in a phase of running a stage, in seconds
+struct Timing
+{
+    Timing() : m_wall(0), m_cpu(0)
+    {}
+
+    Timing& operator+=(const Timing& other)
+    {
+        m_wall += other.m_wall;
+        m_cpu += other.m_cpu;
+        return *this;
+    }
+
+    double m_wall;
+    double m_cpu;   // CPU time of the whole process, over all its threads
+};
+
+// Measures the wall clock and CPU time since it was started
+class Stopwatch
+{
+public:
+    Stopwatch()
+    {
+        restart();
+    }
+
+    void restart()
+    {
+        m_wall = std::chrono::steady_clock::now();
+        m_cpu = std::clock();
+    }
+
+    Timing elapsed() const
+    {
+        Timing t;
+        t.m_wall = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - m_wall).count();
+        t.m_cpu = double(std::clock() - m_cpu) / CLOCKS_PER_SEC;
+        return t;
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_wall;
+    std::clock_t m_cpu;
+};
+
+} // namespace jlang
+} // namespace pdal
@@ -0,0 +1,323 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#include "ViewStorage.hpp"
+
+#include <pdal/PointTable.hpp>
+
+#include <algorithm>
+
+namespace pdal
+{
+namespace jlang
+{
+
+namespace
+{
+
+// Exposes the address of a field in a ColumnPointTable.
+class ColumnTableAccess : public ColumnPointTable
+{
+public:
+    static char *dimension(ColumnPointTable& table,
+        const Dimension::Detail *dd, PointId idx)
+    {
+        char *(ColumnPointTable::*get)(const Dimension::Detail *, PointId) =
+            &ColumnTableAccess::getDimension;
+        return (table.*get)(dd, idx);
+    }
+};
+
+// Exposes the address of a field in a row-major table.
+class RowTableAccess : public SimplePointTable
+{
+public:
+    static char *dimension(SimplePointTable& table,
+        const Dimension::Detail *dd, PointId idx)
+    {
+        char *(SimplePointTable::*get)(const Dimension::Detail *, PointId) =
+            &RowTableAccess::getDimension;
+        return (table.*get)(dd, idx);
+    }
+};
+
+// Exposes the index list mapping view positions to table positions.
+class PointViewAccess : public PointView
+{
+public:
+    static const std::deque<PointId>& index(const PointView& view)
+    {
+        const std::deque<PointId> PointView::*index = &PointViewAccess::m_index;
+        return view.*index;
+    }
+};
+
+} // unnamed namespace
+
+
+ViewStorage::ViewStorage(PointView& view) :
+    ViewStorage(view, 0, view.size())
+{
+    m_whole = true;
+}
+
+
+// A window can't grow, as the points after it belong to the view
+ViewStorage::ViewStorage(PointView& view, PointId first,
+        point_count_t count) : m_view(&view), m_table(nullptr),
+    m_index(&PointViewAccess::index(view)), m_first(first), m_whole(false),
+    m_count(count), m_layout(view.layout()),
+    m_columnTable(dynamic_cast<ColumnPointTable *>(&view.table()))
+{
+    SimplePointTable *rowTable =
+        dynamic_cast<SimplePointTable *>(&view.table());
+    if (m_columnTable)
+        findColumnRuns();
+    else if (rowTable)
+        findRows(*rowTable);
+}
+
+
+ViewStorage::ViewStorage(BasePointTable& table, PointId first,
+        point_count_t count) : m_view(nullptr), m_table(&table),
+    m_index(nullptr), m_first(first), m_whole(false), m_count(count),
+    m_layout(table.layout()),
+    m_columnTable(dynamic_cast<ColumnPointTable *>(&table))
+{
+    SimplePointTable *rowTable = dynamic_cast<SimplePointTable *>(&table);
+    if (m_columnTable)
+        findColumnRuns();
+    else if (rowTable)
+        findRows(*rowTable);
+}
+
+
+// The rows must outlive the storage
+ViewStorage::ViewStorage(BasePointTable& table,
+        const std::deque<PointId>& rows) : m_view(nullptr), m_table(&table),
+    m_index(&rows), m_first(0), m_whole(false), m_count(rows.size()),
+    m_layout(table.layout()),
+    m_columnTable(dynamic_cast<ColumnPointTable *>(&table))
+{
+    SimplePointTable *rowTable = dynamic_cast<SimplePointTable *>(&table);
+    if (m_columnTable)
+        findColumnRuns();
+    else if (rowTable)
+        findRows(*rowTable);
+}
+
+
+// The runs of a row-major table are the same for every dimension, so find
+// them once, relative to the start of each point.
+void ViewStorage::findRows(SimplePointTable& table)
+{
+    if (m_layout->dims().empty())
+        return;
+
+    const Dimension::Detail *dd = m_layout->dimDetail(m_layout->dims()[0]);
+    m_rows = findSpans<RowTableAccess>(table, dd, m_layout->pointSize());
+    for (Span& s : m_rows)
+        s.m_data -= dd->offset();
+}
+
+
+// A column table keeps each dimension in blocks of the same number of
+// points, so the positions at which the points' memory breaks are the same
+// for every dimension. Find them once from the view's index, so that each
+// dimension's spans then take one access per run rather than one per point.
+void ViewStorage::findColumnRuns()
+{
+    if (m_layout->dims().empty() || m_count == 0)
+        return;
+
+    PointId last = 0;
+    for (PointId idx = 0; idx < m_count; ++idx)
+        last = (std::max)(last, tableId(idx));
+
+    // The block size isn't public, so take it from the first break in the
+    // memory of a dimension, looking no further than the points used.
+    const Dimension::Detail *dd = m_layout->dimDetail(m_layout->dims()[0]);
+    char *base = ColumnTableAccess::dimension(*m_columnTable, dd, 0);
+    point_count_t block = last + 1;
+    for (PointId id = 1; id <= last; ++id)
+        if (ColumnTableAccess::dimension(*m_columnTable, dd, id) !=
+                base + id * dd->size())
+        {
+            block = id;
+            break;
+        }
+
+    for (PointId idx = 0; idx < m_count; ++idx)
+    {
+        const PointId id = tableId(idx);
+        if (m_columnRuns.size())
+        {
+            IdRun& run = m_columnRuns.back();
+            if (id == run.m_first + run.m_count && id % block != 0)
+            {
+                run.m_count++;
+                continue;
+            }
+        }
+        m_columnRuns.push_back(IdRun { id, 1 });
+    }
+}
+
+
+// Splits the fields of the points into runs that are stride bytes apart.
+template<typename Access, typename Table>
+std::vector<Span> ViewStorage::findSpans(Table& table,
+    const Dimension::Detail *dd, std::ptrdiff_t stride) const
+{
+    std::vector<Span> spans;
+    for (PointId idx = 0; idx < m_count; ++idx)
+    {
+        char *p = Access::dimension(table, dd, tableId(idx));
+        if (spans.size())
+        {
+            Span& last = spans.back();
+            if (p == last.m_data + last.m_stride * (std::ptrdiff_t)last.m_count)
+            {
+                last.m_count++;
+                continue;
+            }
+        }
+        spans.push_back(Span { p, stride, 1 });
+    }
+    return spans;
+}
+
+
+std::vector<Span> ViewStorage::spans(const Dimension::Detail *dd) const
+{
+    if (m_columnTable)
+    {
+        // Check each run's ends, in case a later block is a different size
+        // from the first, and split any that aren't packed point by point.
+        const std::ptrdiff_t size = dd->size();
+        std::vector<Span> spans;
+        for (const IdRun& run : m_columnRuns)
+        {
+            char *first =
+                ColumnTableAccess::dimension(*m_columnTable, dd, run.m_first);
+            char *last = ColumnTableAccess::dimension(*m_columnTable, dd,
+                run.m_first + run.m_count - 1);
+            if (last == first + size * (std::ptrdiff_t)(run.m_count - 1))
+            {
+                spans.push_back(Span { first, size, run.m_count });
+                continue;
+            }
+            for (PointId id = run.m_first; id < run.m_first + run.m_count;
+                    ++id)
+                spans.push_back(Span {
+                    ColumnTableAccess::dimension(*m_columnTable, dd, id),
+                    size, 1 });
+        }
+        return spans;
+    }
+
+    std::vector<Span> spans(m_rows);
+    for (Span& s : spans)
+        s.m_data += dd->offset();
+    return spans;
+}
+
+
+void ViewStorage::gather(const Dimension::Detail *dd, Dimension::Type type,
+    char *dst, const std::vector<Span>& runs) const
+{
+    if (runs.empty())
+    {
+        // Storage isn't reachable, fall back to PDAL's accessors.
+        for (PointId idx = 0; idx < m_count; ++idx)
+        {
+            if (m_view)
+                m_view->getField(dst, dd->id(), type, m_first + idx);
+            else
+                PointRef(*m_table, tableId(idx)).getField(dst, dd->id(),
+                    type);
+            dst += Dimension::size(type);
+        }
+        return;
+    }
+
+    TransferFn fn = transferKernel(typeIndex(dd->type()), typeIndex(type));
+    jlang::gather(runs, fn, dst, Dimension::size(type));
+}
+
+
+void ViewStorage::scatter(const Dimension::Detail *dd, Dimension::Type type,
+    const char *src, point_count_t count, const std::vector<Span>& runs)
+{
+    point_count_t stored = 0;
+    if (runs.size())
+    {
+        stored = (std::min)(count, m_count);
+        TransferFn fn =
+            transferKernel(typeIndex(type), typeIndex(dd->type()));
+        try
+        {
+            jlang::scatter(src, Dimension::size(type), fn, runs, stored);
+        }
+        catch (const pdal_error& err)
+        {
+            throw pdal_error("filters.julia: " + std::string(err.what()) +
+                " for dimension '" + layout()->dimName(dd->id()) +
+                "' of type " + Dimension::interpretationName(dd->type()) +
+                ".");
+        }
+    }
+
+    // Anything past the end of the storage found above, including values
+    // that append points to a view, goes through PDAL's accessors. A table
+    // range or a window of a view can't grow.
+    const std::size_t size = Dimension::size(type);
+    if (m_view)
+    {
+        if (!m_whole)
+            count = (std::min)(count, m_count);
+        for (PointId idx = stored; idx < count; ++idx)
+            m_view->setField(dd->id(), type, m_first + idx, src + idx * size);
+    }
+    else
+    {
+        count = (std::min)(count, m_count);
+        for (PointId idx = stored; idx < count; ++idx)
+            PointRef(*m_table, tableId(idx)).setField(dd->id(), type,
+                src + idx * size);
+    }
+}
+
+} // namespace jlang
+} // namespace pdal
@@ -0,0 +1,146 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#pragma once
+
+#include <pdal/pdal_internal.hpp>
+
+#include <pdal/PointView.hpp>
+
+#include "Kernels.hpp"
+
+#include <deque>
+
+namespace pdal
+{
+namespace jlang
+{
+
+// Where the values of a set of points live in their point table: the
+// points of a view, a window of positions in a view, or a range or list of
+// positions in a table, as when streaming. PDAL keeps table storage
+// protected, so this reaches it through access shims in order to move whole
+// runs of values instead of calling getField() per point.
+class PDAL_DLL ViewStorage
+{
+public:
+    ViewStorage(PointView& view);
+    ViewStorage(PointView& view, PointId first, point_count_t count);
+    ViewStorage(BasePointTable& table, PointId first, point_count_t count);
+    ViewStorage(BasePointTable& table, const std::deque<PointId>& rows);
+
+    point_count_t size() const
+    {
+        return m_count;
+    }
+
+    PointLayoutPtr layout() const
+    {
+        return m_layout;
+    }
+
+    // The view holding the points, if they are the whole of one
+    PointView *view() const
+    {
+        return m_whole ? m_view : nullptr;
+    }
+
+    // An empty view of the same table, or null when streaming
+    PointViewPtr makeNew() const
+    {
+        return m_view ? m_view->makeNew() : PointViewPtr();
+    }
+
+    // Whether scattering past the end adds points, as it does to a view
+    bool canGrow() const
+    {
+        return m_whole;
+    }
+
+    // Runs of memory holding the dimension for the points of the view, in
+    // order. Empty if the table doesn't expose its storage.
+    std::vector<Span> spans(const Dimension::Detail *dd) const;
+
+    // Copy a dimension into a packed buffer of the given type.
+    void gather(const Dimension::Detail *dd, Dimension::Type type,
+        char *dst) const
+    {
+        gather(dd, type, dst, spans(dd));
+    }
+    void gather(const Dimension::Detail *dd, Dimension::Type type,
+        char *dst, const std::vector<Span>& runs) const;
+
+    // Copy count packed values of the given type into a dimension.
+    void scatter(const Dimension::Detail *dd, Dimension::Type type,
+        const char *src, point_count_t count)
+    {
+        scatter(dd, type, src, count, spans(dd));
+    }
+    void scatter(const Dimension::Detail *dd, Dimension::Type type,
+        const char *src, point_count_t count, const std::vector<Span>& runs);
+
+private:
+    PointId tableId(PointId idx) const
+    {
+        return m_index ? (*m_index)[m_first + idx] : m_first + idx;
+    }
+
+    void findRows(SimplePointTable& table);
+    void findColumnRuns();
+    template<typename Access, typename Table>
+    std::vector<Span> findSpans(Table& table, const Dimension::Detail *dd,
+        std::ptrdiff_t stride) const;
+
+    PointView *m_view;
+    BasePointTable *m_table;
+    const std::deque<PointId> *m_index;   // Positions to table ones
+    PointId m_first;                      // First position of m_index, or
+                                          // of the table
+    bool m_whole;                         // The storage is all of m_view
+    point_count_t m_count;
+    PointLayoutPtr m_layout;
+    ColumnPointTable *m_columnTable;
+    std::vector<Span> m_rows;   // Runs of whole points in a row-major table
+
+    // Consecutive table positions in one block of a column table
+    struct IdRun
+    {
+        PointId m_first;
+        point_count_t m_count;
+    };
+    std::vector<IdRun> m_columnRuns;
+};
+
+} // namespace jlang
+} // namespace pdal
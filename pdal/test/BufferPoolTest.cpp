@@ -0,0 +1,78 @@
+/******************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#include <pdal/pdal_test_main.hpp>
+
+#include "../jlang/BufferPool.hpp"
+
+using namespace pdal;
+
+
+TEST(BufferPoolTest, reuse)
+{
+    jlang::BufferPool pool;
+
+    // Sizes are rounded up to a power of two, of at least a page
+    EXPECT_EQ(jlang::BufferPool::bucket(100), 4096u);
+    EXPECT_EQ(jlang::BufferPool::bucket(8192), 8192u);
+    EXPECT_EQ(jlang::BufferPool::bucket(8193), 16384u);
+
+    // Sizes in the same bucket share a buffer
+    char *buf = pool.acquire(5000);
+    pool.release(buf, 5000);
+    EXPECT_EQ(pool.held(), 8192u);
+    EXPECT_EQ(pool.acquire(6000), buf);
+    EXPECT_EQ(pool.held(), 0u);
+
+    // A steady stream of calls holds no more than one call's buffers
+    pool.release(buf, 6000);
+    for (int i = 0; i < 100; ++i)
+    {
+        char *a = pool.acquire(7000);
+        char *b = pool.acquire(100);
+        pool.release(a, 7000);
+        pool.release(b, 100);
+    }
+    EXPECT_EQ(pool.held(), 8192u + 4096u);
+
+    // Past the limit, the largest free buffers are freed, and so are those
+    // released while it's reached
+    pool.setLimit(4096);
+    EXPECT_EQ(pool.held(), 4096u);
+    char *a = pool.acquire(100);
+    char *b = pool.acquire(100);
+    pool.release(a, 100);
+    pool.release(b, 100);
+    EXPECT_EQ(pool.held(), 4096u);
+}
@@ -0,0 +1,81 @@
+/******************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#include <pdal/pdal_test_main.hpp>
+
+#include "../jlang/Environment.hpp"
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace pdal;
+
+
+TEST(EnvironmentTest, serve)
+{
+    const std::thread::id server = std::this_thread::get_id();
+    std::mutex mutex;
+    std::vector<std::thread::id> ran;
+
+    // Calls from any thread run on the one serving them
+    jlang::Environment::serve([&]()
+    {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i)
+            threads.emplace_back([&]()
+            {
+                jlang::Environment::call([&]()
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ran.push_back(std::this_thread::get_id());
+                });
+            });
+        for (std::thread& t : threads)
+            t.join();
+    });
+    EXPECT_EQ(ran.size(), 4u);
+    for (std::thread::id id : ran)
+        EXPECT_EQ(id, server);
+
+    // Errors are passed back to the caller, and on out of serve()
+    EXPECT_THROW(jlang::Environment::serve([]()
+        {
+            jlang::Environment::call([]() { throw pdal_error("failed"); });
+        }), pdal_error);
+
+    // Without a server, calls run where they're made
+    jlang::Environment::call([&]()
+        { EXPECT_EQ(std::this_thread::get_id(), server); });
+}
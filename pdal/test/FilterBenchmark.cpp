@@ -0,0 +1,142 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+// Times marshalling points into and out of Julia through Invocation, for
+// each dimension type, in row-major and columnar tables. Each iteration runs
+// the whole call, and reports only the time of the phase measured, from the
+// invocation's own stats. The largest sizes need several GB of memory.
+
+#include <benchmark/benchmark.h>
+
+#include <pdal/PointTable.hpp>
+#include <pdal/PointView.hpp>
+#include <pdal/io/FauxReader.hpp>
+
+#include "../jlang/Environment.hpp"
+#include "../jlang/Invocation.hpp"
+
+using namespace pdal;
+using namespace pdal::jlang;
+
+namespace
+{
+
+// `same` returns the table it's given, so nothing is written back, and
+// `copied` returns a new Value column, which is.
+const char *s_source =
+    "module Bench\n"
+    "  using TypedTables\n"
+    "  same(ins) = ins\n"
+    "  copied(ins) = Table(ins, Value = copy(ins.Value))\n"
+    "end\n";
+
+// Points from FauxReader, with a Value dimension of the type benchmarked
+template<typename Table>
+PointViewPtr makeView(Table& table, point_count_t count, Dimension::Type type)
+{
+    table.layout()->registerOrAssignDim("Value", type);
+
+    Options opts;
+    opts.add("bounds", BOX3D(0.0, 0.0, 0.0, 1.0, 1.0, 1.0));
+    opts.add("count", count);
+    opts.add("mode", "ramp");
+    FauxReader reader;
+    reader.setOptions(opts);
+    reader.prepare(table);
+
+    PointViewPtr view = *reader.execute(table).begin();
+    Dimension::Id id = table.layout()->findDim("Value");
+    for (PointId idx = 0; idx < view->size(); ++idx)
+        view->setField(id, idx, idx % 100);
+    return view;
+}
+
+// Point counts from 1e3 to 1e8, by each type in the kernel table
+void sizes(benchmark::internal::Benchmark *b)
+{
+    for (int64_t count = 1000; count <= 100000000; count *= 10)
+        for (std::size_t t = 0; t < NumScalarTypes; ++t)
+            b->Args({ count, (int64_t)t });
+}
+
+} // unnamed namespace
+
+template<typename Table, bool Out>
+static void BM_Marshal(benchmark::State& state)
+{
+    point_count_t count = state.range(0);
+    Dimension::Type type = pdalType(state.range(1));
+    Table table;
+    PointViewPtr view = makeView(table, count, type);
+
+    Script script(s_source, "Bench", Out ? "copied" : "same");
+    Invocation invocation(script, MetadataNode(), "{}");
+    invocation.setReadDims({ table.layout()->findDim("Value") });
+    invocation.setLayout(table.layout());
+
+    std::vector<PointId> rows;
+    for (auto _ : state)
+    {
+        Timing before = Out ? invocation.totals().m_marshalOut :
+            invocation.totals().m_marshalIn;
+        ViewStorage storage(*view);
+        invocation.execute(storage, MetadataNode(), rows);
+        Timing after = Out ? invocation.totals().m_marshalOut :
+            invocation.totals().m_marshalIn;
+        state.SetIterationTime(after.m_wall - before.m_wall);
+    }
+    state.SetBytesProcessed(state.iterations() * count *
+        Dimension::size(type));
+    state.SetLabel(Dimension::interpretationName(type));
+}
+BENCHMARK_TEMPLATE(BM_Marshal, PointTable, false)->Apply(sizes)->
+    UseManualTime();
+BENCHMARK_TEMPLATE(BM_Marshal, ColumnPointTable, false)->Apply(sizes)->
+    UseManualTime();
+BENCHMARK_TEMPLATE(BM_Marshal, PointTable, true)->Apply(sizes)->
+    UseManualTime();
+BENCHMARK_TEMPLATE(BM_Marshal, ColumnPointTable, true)->Apply(sizes)->
+    UseManualTime();
+
+int main(int argc, char **argv)
+{
+    // Held for the whole run, so Julia starts and Bench compiles once
+    EnvironmentPtr env = Environment::get();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
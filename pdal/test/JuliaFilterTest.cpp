@@ -36,16 +36,34 @@
 
 #include <pdal/PipelineManager.hpp>
 #include <pdal/StageFactory.hpp>
+#include <pdal/io/BufferReader.hpp>
 #include <pdal/io/FauxReader.hpp>
 #include <pdal/filters/StatsFilter.hpp>
 #include <pdal/util/FileUtils.hpp>
 
+#include "../filters/JuliaFilter.hpp"
 #include "../jlang/Invocation.hpp"
 
 #include <pdal/StageWrapper.hpp>
+#include <pdal/Streamable.hpp>
 
 #include "Support.hpp"
 
+#include <cstring>
+#include <functional>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
 using namespace pdal;
 using namespace pdal::plang;
 
@@ -53,68 +71,36 @@ using namespace pdal::plang;
 class JuliaFilterTest : public ::testing::Test
 {
 public:
+    // The test links the plugin, so the stages it creates come from there
     virtual void SetUp()
     {
+        JuliaFilter::registerLinked();
     }
 
 };
 
 TEST_F(JuliaFilterTest, JuliaFilterTest_test1)
 {
-    StageFactory f;
-
-    BOX3D bounds1(0.0, 0.0, 0.0, 1.0, 1.0, 1.0);
-    BOX3D bounds2(10.0, 10.0, 10.0, 11.0, 11.0, 11.0);
-    FauxReader reader1;
-    FauxReader reader2;
-
-    Options ops1;
-    ops1.add("bounds", bounds1);
-    ops1.add("count", 10);
-    ops1.add("mode", "ramp");
-    reader1.setOptions(ops1);
-
-    Options ops2;
-    ops2.add("bounds", bounds2);
-    ops2.add("count", 10);
-    ops2.add("mode", "ramp");
-    reader2.setOptions(ops2);
-
     // Can use 3rd party deps in the submitted src
-    Option source("source", "module MyModule\n"
+    JuliaPipeline p(JuliaPipeline::source("module MyModule\n"
                    "using TypedTables\n"
                    // "using RoamesGeometry\n"
                    "  function myfunc(input)\n"
                    "    return input\n"
                    "  end\n"
-                   "end\n");
-    Option module("module", "MyModule");
-    Option function("function", "myfunc");
-    Options opts;
-    opts.add(source);
-    opts.add(module);
-    opts.add(function);
-
-    Stage* filter(f.createStage("filters.julia"));
-    if (!filter)
-        throw pdal::pdal_error("Unable to create filters.julia");
-    filter->setOptions(opts);
-    filter->setInput(reader1);
-    filter->setInput(reader2);
-
-    std::unique_ptr<StatsFilter> stats(new StatsFilter);
-    stats->setInput(*filter);
+                   "end\n", "MyModule", "myfunc"));
+    p.ramp(10).ramp(10, 10.0, 11.0);
 
     PointTable table;
 
-    stats->prepare(table);
-    PointViewSet viewSet = stats->execute(table);
+    PointViewSet viewSet = p.execute(table);
     EXPECT_EQ(viewSet.size(), 2u);
 
-    const stats::Summary& statsX = stats->getStats(Dimension::Id::X);
-    const stats::Summary& statsY = stats->getStats(Dimension::Id::Y);
-    const stats::Summary& statsZ = stats->getStats(Dimension::Id::Z);
-    const stats::Summary& statsOffsetTime = stats->getStats(Dimension::Id::OffsetTime);
+    const stats::Summary& statsX = p.stats(Dimension::Id::X);
+    const stats::Summary& statsY = p.stats(Dimension::Id::Y);
+    const stats::Summary& statsZ = p.stats(Dimension::Id::Z);
+    const stats::Summary& statsOffsetTime =
+        p.stats(Dimension::Id::OffsetTime);
 
     // Data is passed directly through identity filter
     EXPECT_DOUBLE_EQ(statsX.minimum(), 0.0);
@@ -132,53 +118,20 @@ TEST_F(JuliaFilterTest, JuliaFilterTest_test1)
 
 TEST_F(JuliaFilterTest, JuliaFilterTest_test2)
 {
-    StageFactory f;
+    JuliaPipeline p(JuliaPipeline::script("./test/data/test1.jl",
+        "TestModule", "fff"));
+    p.ramp(10).ramp(10, 10.0, 11.0);
 
-    BOX3D bounds1(0.0, 0.0, 0.0, 1.0, 1.0, 1.0);
-    BOX3D bounds2(10.0, 10.0, 10.0, 11.0, 11.0, 11.0);
-    FauxReader reader1;
-    FauxReader reader2;
-
-    Options ops1;
-    ops1.add("bounds", bounds1);
-    ops1.add("count", 10);
-    ops1.add("mode", "ramp");
-    reader1.setOptions(ops1);
-
-    Options ops2;
-    ops2.add("bounds", bounds2);
-    ops2.add("count", 10);
-    ops2.add("mode", "ramp");
-    reader2.setOptions(ops2);
-
-    Option script("script", "./test/data/test1.jl");
-    Option module("module", "TestModule");
-    Option function("function", "fff");
-    Options opts;
-    opts.add(script);
-    opts.add(module);
-    opts.add(function);
-
-    Stage* filter(f.createStage("filters.julia"));
-    if (!filter)
-        throw pdal::pdal_error("Unable to create filters.julia");
-    filter->setOptions(opts);
-    filter->setInput(reader1);
-    filter->setInput(reader2);
-
-    std::unique_ptr<StatsFilter> stats(new StatsFilter);
-    stats->setInput(*filter);
-
-    PointTable table;
-
-    stats->prepare(table);
-    PointViewSet viewSet = stats->execute(table);
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
     EXPECT_EQ(viewSet.size(), 2u);
 
-    const stats::Summary& statsX = stats->getStats(Dimension::Id::X);
-    const stats::Summary& statsY = stats->getStats(Dimension::Id::Y);
-    const stats::Summary& statsZ = stats->getStats(Dimension::Id::Z);
-    const stats::Summary& statsOffsetTime = stats->getStats(Dimension::Id::OffsetTime);
+    const stats::Summary& statsX = p.stats(Dimension::Id::X);
+    const stats::Summary& statsY = p.stats(Dimension::Id::Y);
+    const stats::Summary& statsZ = p.stats(Dimension::Id::Z);
+    const stats::Summary& statsOffsetTime =
+        p.stats(Dimension::Id::OffsetTime);
 
     // Filter overwrites X and Y values of each row
     EXPECT_DOUBLE_EQ(statsX.minimum(), 99.0);
@@ -194,3 +147,1044 @@ TEST_F(JuliaFilterTest, JuliaFilterTest_test2)
     EXPECT_EQ(statsOffsetTime.maximum(), 9);
 }
 
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_columnTable)
+{
+    // Columns of a ColumnPointTable are handed to Julia without a copy, so
+    // the changes made by the function land directly in the table. The
+    // view's 10000 points fit in one of the table's blocks. A view of
+    // 200000 spans several, so is gathered a run per block and copied.
+    for (point_count_t count : { 10000, 200000 })
+    {
+        JuliaPipeline p(JuliaPipeline::script("./test/data/test1.jl",
+            "TestModule", "fff"));
+        p.ramp(count);
+
+        ColumnPointTable table;
+
+        PointViewSet viewSet = p.execute(table);
+        EXPECT_EQ(viewSet.size(), 1u);
+        EXPECT_EQ((*viewSet.begin())->size(), count);
+
+        uint64_t copied = p.timings().findChild("view").
+            findChild("bytes_in").value<uint64_t>();
+        if (count == 10000)
+            EXPECT_EQ(copied, 0u);
+        else
+            EXPECT_GT(copied, 0u);
+
+        const stats::Summary& statsX = p.stats(Dimension::Id::X);
+        const stats::Summary& statsY = p.stats(Dimension::Id::Y);
+        const stats::Summary& statsZ = p.stats(Dimension::Id::Z);
+
+        EXPECT_DOUBLE_EQ(statsX.minimum(), 99.0);
+        EXPECT_DOUBLE_EQ(statsX.maximum(), 99.0);
+
+        EXPECT_DOUBLE_EQ(statsY.minimum(), 999.0);
+        EXPECT_DOUBLE_EQ(statsY.maximum(), 999.0);
+
+        EXPECT_DOUBLE_EQ(statsZ.minimum(), 0.0);
+        EXPECT_DOUBLE_EQ(statsZ.maximum(), 1.0);
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_readDims)
+{
+    // Only Z is named in the script, so only Z is passed to Julia
+    Options opts = JuliaPipeline::source("module MyModule\n"
+                   "  function myfunc(ins)\n"
+                   "    ins.Z .= ins.Z .+ 5.0\n"
+                   "    return ins\n"
+                   "  end\n"
+                   "end\n", "MyModule", "myfunc");
+    opts.add("read_dims", "auto");
+    JuliaPipeline p(opts);
+    p.ramp(10);
+
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
+    EXPECT_EQ(viewSet.size(), 1u);
+
+    const stats::Summary& statsX = p.stats(Dimension::Id::X);
+    const stats::Summary& statsZ = p.stats(Dimension::Id::Z);
+
+    EXPECT_DOUBLE_EQ(statsX.minimum(), 0.0);
+    EXPECT_DOUBLE_EQ(statsX.maximum(), 1.0);
+
+    EXPECT_DOUBLE_EQ(statsZ.minimum(), 5.0);
+    EXPECT_DOUBLE_EQ(statsZ.maximum(), 6.0);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_writeDims)
+{
+    // The script changes X and Y in place, but only Y is written back,
+    // including when the columns are a ColumnPointTable's own memory
+    PointTable pointTable;
+    ColumnPointTable columnTable;
+    for (BasePointTable *table :
+        std::vector<BasePointTable *>{ &pointTable, &columnTable })
+    {
+        Options opts = JuliaPipeline::script("./test/data/test1.jl",
+            "TestModule", "fff");
+        opts.add("write_dims", "Y");
+        JuliaPipeline p(opts);
+        p.ramp(10);
+
+        PointViewSet viewSet = p.execute(*table);
+        EXPECT_EQ(viewSet.size(), 1u);
+
+        const stats::Summary& statsX = p.stats(Dimension::Id::X);
+        const stats::Summary& statsY = p.stats(Dimension::Id::Y);
+
+        EXPECT_DOUBLE_EQ(statsX.minimum(), 0.0);
+        EXPECT_DOUBLE_EQ(statsX.maximum(), 1.0);
+
+        EXPECT_DOUBLE_EQ(statsY.minimum(), 999.0);
+        EXPECT_DOUBLE_EQ(statsY.maximum(), 999.0);
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_twoStages)
+{
+    // Both stages share one Julia runtime
+    JuliaPipeline first(JuliaPipeline::script("./test/data/test1.jl",
+        "TestModule", "fff"));
+    first.ramp(10);
+    JuliaPipeline second(JuliaPipeline::source("module SecondModule\n"
+                   "  function shift(ins)\n"
+                   "    ins.Z .= ins.Z .+ 5.0\n"
+                   "    return ins\n"
+                   "  end\n"
+                   "end\n", "SecondModule", "shift"));
+    second.input(first.filter());
+
+    PointTable table;
+
+    PointViewSet viewSet = second.execute(table);
+    EXPECT_EQ(viewSet.size(), 1u);
+
+    const stats::Summary& statsX = second.stats(Dimension::Id::X);
+    const stats::Summary& statsZ = second.stats(Dimension::Id::Z);
+
+    EXPECT_DOUBLE_EQ(statsX.minimum(), 99.0);
+    EXPECT_DOUBLE_EQ(statsX.maximum(), 99.0);
+
+    EXPECT_DOUBLE_EQ(statsZ.minimum(), 5.0);
+    EXPECT_DOUBLE_EQ(statsZ.maximum(), 6.0);
+
+    // Starting the runtime is only reported by the stage that started it
+    int started = 0;
+    for (JuliaPipeline* p : { &first, &second })
+        if (p->timings().findChild("julia_start").valid())
+            started++;
+    EXPECT_EQ(started, 1);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_stream)
+{
+    Options opts = JuliaPipeline::source("module StreamModule\n"
+                   "  function shift(ins)\n"
+                   "    ins.Z .= ins.Z .+ 5.0\n"
+                   "    return ins\n"
+                   "  end\n"
+                   "end\n", "StreamModule", "shift");
+    opts.add("batch_size", 4);
+    JuliaPipeline p(opts);
+    p.ramp(25);
+
+    // Chunks of 10 points, run in batches of 4, 4 and 2
+    FixedPointTable table(10);
+
+    p.execute(table);
+
+    const stats::Summary& statsZ = p.stats(Dimension::Id::Z);
+
+    EXPECT_EQ(statsZ.count(), 25u);
+    EXPECT_DOUBLE_EQ(statsZ.minimum(), 5.0);
+    EXPECT_DOUBLE_EQ(statsZ.maximum(), 6.0);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_streamSkipped)
+{
+    // Each batch counts its points, with and without a batch size
+    const std::vector<std::pair<int, std::pair<double, double>>> cases {
+        { 0, { 2.0, 6.0 } }, { 4, { 1.0, 4.0 } } };
+    for (auto& c : cases)
+    {
+        Options opts = JuliaPipeline::source("module SkipModule\n"
+                       "  function shift(ins)\n"
+                       "    ins.Z .= ins.Z .+ 5.0\n"
+                       "    ins.Count .= length(ins)\n"
+                       "    return ins\n"
+                       "  end\n"
+                       "end\n", "SkipModule", "shift");
+        opts.add("add_dimension", "Count=uint16");
+        if (c.first)
+            opts.add("batch_size", c.first);
+        JuliaPipeline p(opts);
+
+        // Of the chunks of 10 points, the range keeps the first two points
+        // of the first, the last six of the second and all five of the
+        // third. So the second chunk starts after where the first stopped.
+        FauxReader reader;
+        reader.setOptions(JuliaPipeline::rampOptions(25));
+        StageFactory f;
+        Stage* range(f.createStage("filters.range"));
+        Options rangeOpts;
+        rangeOpts.add("limits", "Z[0:0.05],Z[0.55:1]");
+        range->setOptions(rangeOpts);
+        range->setInput(reader);
+        p.input(*range);
+
+        FixedPointTable table(10);
+
+        p.execute(table);
+
+        const stats::Summary& statsZ = p.stats(Dimension::Id::Z);
+        EXPECT_EQ(statsZ.count(), 13u);
+        EXPECT_GE(statsZ.minimum(), 5.0);
+        EXPECT_DOUBLE_EQ(statsZ.maximum(), 6.0);
+
+        const stats::Summary& statsCount =
+            p.stats(table.layout()->findDim("Count"));
+        EXPECT_DOUBLE_EQ(statsCount.minimum(), c.second.first);
+        EXPECT_DOUBLE_EQ(statsCount.maximum(), c.second.second);
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_parallel)
+{
+    Options opts = JuliaPipeline::source("module ParallelModule\n"
+                   "  function shift(ins)\n"
+                   "    ins.Z .= ins.Z .+ 5.0\n"
+                   "    return ins\n"
+                   "  end\n"
+                   "end\n", "ParallelModule", "shift");
+    opts.add("parallel", true);
+    JuliaPipeline p(opts);
+    p.ramp(10).ramp(10, 10.0, 11.0);
+
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
+    EXPECT_EQ(viewSet.size(), 2u);
+
+    const stats::Summary& statsX = p.stats(Dimension::Id::X);
+    const stats::Summary& statsZ = p.stats(Dimension::Id::Z);
+
+    EXPECT_DOUBLE_EQ(statsX.minimum(), 0.0);
+    EXPECT_DOUBLE_EQ(statsX.maximum(), 11.0);
+
+    EXPECT_DOUBLE_EQ(statsZ.minimum(), 5.0);
+    EXPECT_DOUBLE_EQ(statsZ.maximum(), 16.0);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_chunks)
+{
+    // test1.jl works per row, so can run on each chunk separately
+    Options opts = JuliaPipeline::script("./test/data/test1.jl",
+        "TestModule", "fff");
+    opts.add("chunks", 3);
+    JuliaPipeline p(opts);
+    p.ramp(10);
+
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
+    EXPECT_EQ(viewSet.size(), 1u);
+
+    const stats::Summary& statsX = p.stats(Dimension::Id::X);
+    const stats::Summary& statsY = p.stats(Dimension::Id::Y);
+    const stats::Summary& statsZ = p.stats(Dimension::Id::Z);
+
+    EXPECT_EQ(statsX.count(), 10u);
+    EXPECT_DOUBLE_EQ(statsX.minimum(), 99.0);
+    EXPECT_DOUBLE_EQ(statsX.maximum(), 99.0);
+
+    EXPECT_DOUBLE_EQ(statsY.minimum(), 999.0);
+    EXPECT_DOUBLE_EQ(statsY.maximum(), 999.0);
+
+    EXPECT_DOUBLE_EQ(statsZ.minimum(), 0.0);
+    EXPECT_DOUBLE_EQ(statsZ.maximum(), 1.0);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_timings)
+{
+    JuliaPipeline p(JuliaPipeline::script("./test/data/test1.jl",
+        "TestModule", "fff"));
+    p.ramp(10);
+
+    PointTable table;
+
+    p.execute(table);
+
+    MetadataNode timings = p.timings();
+    EXPECT_TRUE(timings.valid());
+    EXPECT_TRUE(timings.findChild("julia_start").valid());
+    EXPECT_TRUE(timings.findChild("compile").valid());
+    EXPECT_TRUE(timings.findChild("warm_up:wall").valid());
+    EXPECT_TRUE(timings.findChild("first_call").valid());
+    EXPECT_EQ(timings.findChild("calls").value<std::size_t>(), 1u);
+
+    MetadataNode view = timings.findChild("view");
+    EXPECT_TRUE(view.valid());
+    EXPECT_EQ(view.findChild("points").value<point_count_t>(), 10u);
+    EXPECT_TRUE(view.findChild("function:wall").valid());
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_filterTable)
+{
+    // Z ramps from 0 to 1 in ninths, so five points are kept
+    JuliaPipeline p(JuliaPipeline::source("module FilterModule\n"
+                   "  function keep(ins)\n"
+                   "    return filter(p -> p.Z > 0.5, ins)\n"
+                   "  end\n"
+                   "end\n", "FilterModule", "keep"));
+    p.ramp(10);
+
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
+    EXPECT_EQ(viewSet.size(), 1u);
+
+    PointViewPtr view = *viewSet.begin();
+    EXPECT_EQ(view->size(), 5u);
+    for (PointId idx = 0; idx < view->size(); ++idx)
+    {
+        EXPECT_GT(view->getFieldAs<double>(Dimension::Id::Z, idx), 0.5);
+        EXPECT_DOUBLE_EQ(view->getFieldAs<double>(Dimension::Id::X, idx),
+            view->getFieldAs<double>(Dimension::Id::Z, idx));
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_filterTableCopies)
+{
+    // Rows of a shorter table are new points, so the points given are left
+    // as they were for any other view of them. Also in windows of 4 points,
+    // of which the first keeps none, the second two and the last all.
+    for (int chunkSize : { 0, 4 })
+    {
+        PointTable table;
+        table.layout()->registerDim(Dimension::Id::X);
+        table.layout()->registerDim(Dimension::Id::Y);
+        table.layout()->registerDim(Dimension::Id::Z);
+
+        PointViewPtr src(new PointView(table));
+        for (PointId idx = 0; idx < 10; ++idx)
+        {
+            src->setField(Dimension::Id::X, idx, idx);
+            src->setField(Dimension::Id::Y, idx, idx);
+            src->setField(Dimension::Id::Z, idx, idx);
+        }
+        BufferReader reader;
+        reader.addView(src);
+
+        Options opts = JuliaPipeline::source("module FilterModule\n"
+                       "  keep(ins) = filter(p -> p.Z > 5.5, ins)\n"
+                       "end\n", "FilterModule", "keep");
+        if (chunkSize)
+            opts.add("chunk_size", chunkSize);
+        JuliaPipeline p(opts);
+        p.input(reader);
+
+        PointViewSet viewSet = p.execute(table);
+        ASSERT_EQ(viewSet.size(), 1u);
+
+        PointViewPtr view = *viewSet.begin();
+        ASSERT_EQ(view->size(), 4u);
+        for (PointId idx = 0; idx < view->size(); ++idx)
+            EXPECT_DOUBLE_EQ(view->getFieldAs<double>(Dimension::Id::Z, idx),
+                idx + 6.0);
+
+        ASSERT_EQ(src->size(), 10u);
+        for (PointId idx = 0; idx < src->size(); ++idx)
+            EXPECT_DOUBLE_EQ(src->getFieldAs<double>(Dimension::Id::Z, idx),
+                (double)idx);
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_filterMaskStream)
+{
+    // Only Z is passed in, and a mask comes back
+    Options opts = JuliaPipeline::source("module MaskModule\n"
+                   "  function keep(ins)\n"
+                   "    return ins.Z .> 0.5\n"
+                   "  end\n"
+                   "end\n", "MaskModule", "keep");
+    opts.add("read_dims", "Z");
+    JuliaPipeline p(opts);
+    p.ramp(10);
+
+    FixedPointTable table(4);
+
+    p.execute(table);
+
+    const stats::Summary& statsZ = p.stats(Dimension::Id::Z);
+
+    EXPECT_EQ(statsZ.count(), 5u);
+    EXPECT_GT(statsZ.minimum(), 0.5);
+    EXPECT_DOUBLE_EQ(statsZ.maximum(), 1.0);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_split)
+{
+    // One selection and one table
+    JuliaPipeline p(JuliaPipeline::source("module SplitModule\n"
+                   "  function split(ins)\n"
+                   "    return [findall(ins.Z .<= 0.5), "
+                   "filter(p -> p.Z > 0.5, ins)]\n"
+                   "  end\n"
+                   "end\n", "SplitModule", "split"));
+    p.ramp(10);
+
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
+    ASSERT_EQ(viewSet.size(), 2u);
+
+    auto it = viewSet.begin();
+    PointViewPtr low = *it++;
+    PointViewPtr high = *it;
+    EXPECT_EQ(low->size(), 5u);
+    EXPECT_EQ(high->size(), 5u);
+    for (PointId idx = 0; idx < 5; ++idx)
+    {
+        EXPECT_LE(low->getFieldAs<double>(Dimension::Id::Z, idx), 0.5);
+        EXPECT_GT(high->getFieldAs<double>(Dimension::Id::Z, idx), 0.5);
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_splitInvalid)
+{
+    // Parts of a list that are neither tables nor selections fail the
+    // stage rather than being read as one
+    for (const std::string ret : { "(ins, nothing)", "[ins, [1.5, 2.5]]",
+            "[ins, [ins, ins]]" })
+    {
+        JuliaPipeline p(JuliaPipeline::source("module SplitModule\n"
+                       "  split(ins) = " + ret + "\n"
+                       "end\n", "SplitModule", "split"));
+        p.ramp(10);
+
+        PointTable table;
+        EXPECT_THROW(p.execute(table), pdal_error) << ret;
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_groupBy)
+{
+    // The function computes the key to split the points by
+    Options opts = JuliaPipeline::source("module GroupModule\n"
+                   "  function tile(ins)\n"
+                   "    ins.Tile .= ins.Z .> 0.5\n"
+                   "    return ins\n"
+                   "  end\n"
+                   "end\n", "GroupModule", "tile");
+    opts.add("add_dimension", "Tile=uint8");
+    opts.add("group_by", "Tile");
+    JuliaPipeline p(opts);
+    p.ramp(10);
+
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
+    ASSERT_EQ(viewSet.size(), 2u);
+
+    Dimension::Id tile = table.layout()->findDim("Tile");
+    int expected = 0;
+    for (const PointViewPtr& view : viewSet)
+    {
+        EXPECT_EQ(view->size(), 5u);
+        for (PointId idx = 0; idx < view->size(); ++idx)
+            EXPECT_EQ(view->getFieldAs<int>(tile, idx), expected);
+        expected++;
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_chunkSize)
+{
+    // Windows of 3, 3, 3 and 1 points. Each changes X and keeps the points
+    // of its window with Z over 0.5, five in all.
+    Options opts = JuliaPipeline::source("module WindowModule\n"
+                   "  function keep(ins)\n"
+                   "    ins.X .= ins.Z .* 2\n"
+                   "    return filter(p -> p.Z > 0.5, ins)\n"
+                   "  end\n"
+                   "end\n", "WindowModule", "keep");
+    opts.add("chunk_size", 3);
+    JuliaPipeline p(opts);
+    p.ramp(10);
+
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
+    EXPECT_EQ(viewSet.size(), 1u);
+
+    PointViewPtr view = *viewSet.begin();
+    EXPECT_EQ(view->size(), 5u);
+    for (PointId idx = 0; idx < view->size(); ++idx)
+    {
+        double z = view->getFieldAs<double>(Dimension::Id::Z, idx);
+        EXPECT_GT(z, 0.5);
+        EXPECT_DOUBLE_EQ(view->getFieldAs<double>(Dimension::Id::X, idx),
+            z * 2);
+    }
+
+    EXPECT_EQ(p.timings().findChild("calls").value<std::size_t>(), 4u);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_memoryLimit)
+{
+    // Only Z is copied, 8 bytes a point. Two windows of 3072 points would
+    // fit 48 KiB, but each is copied into a buffer rounded up to 32 KiB, so
+    // the windows are of 2048 points, in buffers of 16 KiB.
+    Options opts = JuliaPipeline::source("module LimitModule\n"
+                   "  shift(ins) = (ins.Z .+= 1.0; ins)\n"
+                   "end\n", "LimitModule", "shift");
+    opts.add("read_dims", "Z");
+    opts.add("memory_limit", 3 * 16384);
+    JuliaPipeline p(opts);
+    p.ramp(10000);
+
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
+    EXPECT_EQ((*viewSet.begin())->size(), 10000u);
+    EXPECT_EQ(p.timings().findChild("calls").value<std::size_t>(), 5u);
+
+    const stats::Summary& statsZ = p.stats(Dimension::Id::Z);
+    EXPECT_DOUBLE_EQ(statsZ.minimum(), 1.0);
+    EXPECT_DOUBLE_EQ(statsZ.maximum(), 2.0);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_cacheDir)
+{
+    const std::string cacheDir = Support::temppath("julia-cache");
+    FileUtils::deleteDirectory(cacheDir);
+
+    // The script is compiled into a package in the cache
+    Options opts = JuliaPipeline::source("module CacheModule\n"
+                   "  function keep(ins)\n"
+                   "    return filter(p -> p.Z > 0.5, ins)\n"
+                   "  end\n"
+                   "end\n", "CacheModule", "keep");
+    opts.add("cache_dir", cacheDir);
+    JuliaPipeline p(opts);
+    p.ramp(10);
+
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
+    EXPECT_EQ(viewSet.size(), 1u);
+    EXPECT_EQ((*viewSet.begin())->size(), 5u);
+
+    EXPECT_EQ(FileUtils::glob(cacheDir + "/PdalScript_*").size(), 1u);
+    std::vector<std::string> compiled =
+        FileUtils::glob(cacheDir + "/compiled/*/PdalScript_*/*.ji");
+    ASSERT_EQ(compiled.size(), 1u);
+
+    // Another stage with the script loads the package rather than
+    // compiling it again
+    JuliaPipeline p2(opts);
+    p2.ramp(10);
+
+    PointTable table2;
+    viewSet = p2.execute(table2);
+    EXPECT_EQ((*viewSet.begin())->size(), 5u);
+    EXPECT_EQ(FileUtils::glob(cacheDir + "/compiled/*/PdalScript_*/*.ji"),
+        compiled);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_daemonMissing)
+{
+    Options opts = JuliaPipeline::source("module MyModule\n"
+                   "  function fff(ins)\n"
+                   "    return ins\n"
+                   "  end\n"
+                   "end\n", "MyModule", "fff");
+    opts.add("daemon", Support::temppath("no-julia-daemon.sock"));
+    JuliaPipeline p(opts);
+    p.ramp(10);
+
+    // Nothing is listening, which fails the stage rather than falling back
+    // to running Julia in this process
+    PointTable table;
+    EXPECT_THROW(p.execute(table), pdal_error);
+}
+
+#ifndef _WIN32
+namespace
+{
+
+// Serves the protocol of jl/Daemon.jl (see DaemonClient.cpp) to one stage,
+// with a handler in place of the Julia function. The handler is given the
+// mapped columns by name and the number of points, and returns the reply.
+class FakeDaemon
+{
+public:
+    typedef std::function<std::string(std::map<std::string, char *>&,
+        point_count_t)> Handler;
+
+    FakeDaemon(const std::string& path, Handler handler) : m_path(path),
+        m_handler(handler)
+    {
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        ::unlink(path.c_str());
+        m_listen = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (::bind(m_listen, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+                ::listen(m_listen, 1) != 0)
+            throw pdal_error("Unable to listen on " + path);
+        m_thread = std::thread([this]() { serve(); });
+    }
+
+    // Waits for the stage to close its connection, if it connected
+    ~FakeDaemon()
+    {
+        join();
+        ::close(m_listen);
+        ::unlink(m_path.c_str());
+    }
+
+    void join()
+    {
+        if (!m_thread.joinable())
+            return;
+        ::shutdown(m_listen, SHUT_RDWR);
+        m_thread.join();
+    }
+
+    // The size of the source sent with each request, once join() returns
+    const std::vector<std::size_t>& sourceSizes() const
+    {
+        return m_sourceSizes;
+    }
+
+private:
+    static bool readLine(int conn, std::string& line)
+    {
+        line.clear();
+        char c;
+        while (::recv(conn, &c, 1, 0) == 1)
+        {
+            if (c == '\n')
+                return true;
+            line += c;
+        }
+        return false;
+    }
+
+    void serve()
+    {
+        int conn = ::accept(m_listen, nullptr, nullptr);
+        if (conn < 0)
+            return;
+
+        std::string line;
+        while (readLine(conn, line))
+        {
+            std::string verb, path;
+            std::size_t size;
+            point_count_t points;
+            std::istringstream(line) >> verb >> path >> size >> points;
+
+            // The script isn't run, so its source is skipped. Only the
+            // first request is expected to carry it.
+            std::string word, key;
+            std::size_t sourceSize = 0;
+            readLine(conn, line);
+            std::istringstream(line) >> word >> key >> word >> word >>
+                sourceSize;
+            std::vector<char> source(sourceSize);
+            if (sourceSize)
+            {
+                ::recv(conn, source.data(), sourceSize, MSG_WAITALL);
+                m_keys.insert(key);
+            }
+            m_sourceSizes.push_back(sourceSize);
+
+            std::vector<std::pair<std::string, std::size_t>> dims;
+            while (readLine(conn, line) && line != "end")
+            {
+                std::string name;
+                int type;
+                std::size_t offset;
+                std::istringstream(line) >> word >> name >> type >> offset;
+                dims.push_back({ name, offset });
+            }
+
+            std::string reply = "ok\n";
+            if (!m_keys.count(key))
+                reply = "error no script was sent with key " + key + "\n";
+            else if (verb == "run")
+            {
+                int fd = ::open(path.c_str(), O_RDWR);
+                char *map = (char *)::mmap(nullptr, size,
+                    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                std::map<std::string, char *> columns;
+                for (auto& d : dims)
+                    columns[d.first] = map + d.second;
+                reply = m_handler(columns, points);
+                ::munmap(map, size);
+                ::close(fd);
+            }
+            ::send(conn, reply.data(), reply.size(), 0);
+        }
+        ::close(conn);
+    }
+
+    std::string m_path;
+    Handler m_handler;
+    int m_listen;
+    std::thread m_thread;
+    std::set<std::string> m_keys;
+    std::vector<std::size_t> m_sourceSizes;
+};
+
+} // unnamed namespace
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_daemon)
+{
+    const std::string path = "/tmp/pdal-julia-test-" +
+        std::to_string(::getpid()) + ".sock";
+    MetadataNode metadata;
+    std::vector<std::size_t> sourceSizes;
+
+    // Runs ten points ramping from 0 to 1 through a daemon serving the
+    // handler, and returns the Z of each point returned, and the value of
+    // the dimension added, if any. The daemon is declared first so the
+    // stage closes its connection before the daemon waits for it.
+    auto run = [&path, &metadata, &sourceSizes](FakeDaemon::Handler handler,
+        const std::string& addDim)
+    {
+        FakeDaemon daemon(path, handler);
+        std::vector<std::pair<double, double>> rows;
+        {
+            Options opts = JuliaPipeline::source("module DaemonModule\n"
+                           "  fff(ins) = ins\n"
+                           "end\n", "DaemonModule", "fff");
+            opts.add("daemon", path);
+            if (addDim.size())
+                opts.add("add_dimension", addDim);
+            JuliaPipeline p(opts);
+            p.ramp(10);
+
+            PointTable table;
+            PointViewSet viewSet = p.execute(table);
+            metadata = p.filter().getMetadata();
+
+            Dimension::Id added = addDim.size() ?
+                table.layout()->findDim(addDim.substr(0, addDim.find('='))) :
+                Dimension::Id::Unknown;
+            for (const PointViewPtr& view : viewSet)
+                for (PointId idx = 0; idx < view->size(); ++idx)
+                    rows.push_back({
+                        view->getFieldAs<double>(Dimension::Id::Z, idx),
+                        added == Dimension::Id::Unknown ? 0.0 :
+                            view->getFieldAs<double>(added, idx) });
+        }
+
+        // The stage has closed its connection
+        daemon.join();
+        sourceSizes = daemon.sourceSizes();
+        return rows;
+    };
+
+    // Columns changed in the file are written back, and timed
+    auto rows = run([](std::map<std::string, char *>& columns,
+        point_count_t count)
+    {
+        double *z = (double *)columns["Z"];
+        for (point_count_t i = 0; i < count; ++i)
+            z[i] += 5.0;
+        return std::string("ok\n");
+    }, "");
+    ASSERT_EQ(rows.size(), 10u);
+    for (std::size_t i = 0; i < rows.size(); ++i)
+        EXPECT_DOUBLE_EQ(rows[i].first, i / 9.0 + 5.0);
+    MetadataNode timings = metadata.findChild("timings");
+    EXPECT_TRUE(timings.findChild("warm_up:wall").valid());
+    EXPECT_EQ(timings.findChild("calls").value<std::size_t>(), 1u);
+    EXPECT_EQ(timings.findChild("total:points").value<point_count_t>(), 10u);
+    EXPECT_EQ(timings.findChild("total:bytes_out").value<uint64_t>(), 80u);
+    EXPECT_TRUE(timings.findChild("view:function:wall").valid());
+
+    // The script went with the warm-up request only, and the run named it
+    // by its key
+    ASSERT_EQ(sourceSizes.size(), 2u);
+    EXPECT_GT(sourceSizes[0], 0u);
+    EXPECT_EQ(sourceSizes[1], 0u);
+
+    // The points kept
+    rows = run([](std::map<std::string, char *>&, point_count_t)
+    {
+        const int64_t kept[] = { 2, 4, 6 };
+        return std::string("keep 3\n") +
+            std::string((const char *)kept, sizeof(kept));
+    }, "");
+    ASSERT_EQ(rows.size(), 3u);
+    for (std::size_t i = 0; i < rows.size(); ++i)
+        EXPECT_DOUBLE_EQ(rows[i].first, (2 * i + 1) / 9.0);
+
+    // A dimension the stage adds is passed in and written back
+    rows = run([](std::map<std::string, char *>& columns,
+        point_count_t count)
+    {
+        uint16_t *extra = (uint16_t *)columns["Extra"];
+        for (point_count_t i = 0; i < count; ++i)
+            extra[i] = 3 * i;
+        return std::string("ok\n");
+    }, "Extra=uint16");
+    ASSERT_EQ(rows.size(), 10u);
+    for (std::size_t i = 0; i < rows.size(); ++i)
+        EXPECT_DOUBLE_EQ(rows[i].second, 3.0 * i);
+
+    // Errors from the daemon fail the stage with its message
+    try
+    {
+        run([](std::map<std::string, char *>&, point_count_t)
+        {
+            return std::string("error boom\n");
+        }, "");
+        FAIL() << "Expected the daemon's error";
+    }
+    catch (const pdal_error& err)
+    {
+        EXPECT_NE(std::string(err.what()).find("boom"), std::string::npos);
+    }
+}
+#endif
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_pointIndex)
+{
+    // The points are 0.19 apart on a line, so the ends have one other
+    // within 0.2 and the rest two. Each point is its own nearest, by its
+    // row in the whole view though the function runs on two chunks.
+    Options opts = JuliaPipeline::source("module IndexModule\n"
+                   "  using PdalJulia\n"
+                   "  function neighbours(ins, view)\n"
+                   "    counts = zeros(Int64, length(ins))\n"
+                   "    radius!(counts, nothing, view, 0.2, "
+                   "ins.X, ins.Y, ins.Z)\n"
+                   "    nearest = zeros(Int64, 1, length(ins))\n"
+                   "    knn!(nearest, view, ins.X, ins.Y, ins.Z)\n"
+                   "    ins.X .= counts\n"
+                   "    ins.Y .= vec(nearest)\n"
+                   "    return ins\n"
+                   "  end\n"
+                   "end\n", "IndexModule", "neighbours");
+    opts.add("chunks", 2);
+    JuliaPipeline p(opts);
+    p.ramp(10);
+
+    PointTable table;
+
+    PointViewSet viewSet = p.execute(table);
+    EXPECT_EQ(viewSet.size(), 1u);
+
+    PointViewPtr view = *viewSet.begin();
+    EXPECT_EQ(view->size(), 10u);
+    for (PointId idx = 0; idx < view->size(); ++idx)
+    {
+        double count = (idx == 0 || idx == 9) ? 2 : 3;
+        EXPECT_DOUBLE_EQ(view->getFieldAs<double>(Dimension::Id::X, idx),
+            count);
+        EXPECT_DOUBLE_EQ(view->getFieldAs<double>(Dimension::Id::Y, idx),
+            idx + 1);
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_pointIndexMoved)
+{
+    // The first stage queries the index and then moves the points, so the
+    // second has to find them where they are now
+    JuliaPipeline first(JuliaPipeline::source("module MoveModule\n"
+                   "  using PdalJulia\n"
+                   "  function move(ins, view)\n"
+                   "    radius(view, (ins.X[1], ins.Y[1], ins.Z[1]), 0.2)\n"
+                   "    ins.X .+= 100.0\n"
+                   "    return ins\n"
+                   "  end\n"
+                   "end\n", "MoveModule", "move"));
+    first.ramp(10);
+    JuliaPipeline second(JuliaPipeline::source("module CountModule\n"
+                   "  using PdalJulia\n"
+                   "  function neighbours(ins, view)\n"
+                   "    counts = zeros(Int64, length(ins))\n"
+                   "    radius!(counts, nothing, view, 0.2, "
+                   "ins.X, ins.Y, ins.Z)\n"
+                   "    ins.Z .= counts\n"
+                   "    return ins\n"
+                   "  end\n"
+                   "end\n", "CountModule", "neighbours"));
+    second.input(first.filter());
+
+    PointTable table;
+
+    PointViewSet viewSet = second.execute(table);
+    PointViewPtr view = *viewSet.begin();
+    ASSERT_EQ(view->size(), 10u);
+    for (PointId idx = 0; idx < view->size(); ++idx)
+    {
+        double count = (idx == 0 || idx == 9) ? 2 : 3;
+        EXPECT_DOUBLE_EQ(view->getFieldAs<double>(Dimension::Id::Z, idx),
+            count);
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_radialDensity)
+{
+    StageFactory f;
+
+    Options readOpts;
+    readOpts.add("filename", Support::datapath("autzen.las"));
+
+    // The runtime's kernel gives the same densities as the native filter
+    Stage* nativeReader(f.createStage("readers.las"));
+    nativeReader->setOptions(readOpts);
+    Options nativeOpts;
+    nativeOpts.add("radius", 5.0);
+    Stage* native(f.createStage("filters.radialdensity"));
+    native->setOptions(nativeOpts);
+    native->setInput(*nativeReader);
+
+    Stage* juliaReader(f.createStage("readers.las"));
+    juliaReader->setOptions(readOpts);
+    Options opts = JuliaPipeline::source("module DensityModule\n"
+                   "  using PdalJulia\n"
+                   "  function density(ins)\n"
+                   "    radialDensity!(ins.RadialDensity, "
+                   "ins.X, ins.Y, ins.Z, 5.0)\n"
+                   "    return ins\n"
+                   "  end\n"
+                   "end\n", "DensityModule", "density");
+    opts.add("add_dimension", "RadialDensity");
+    JuliaPipeline p(opts);
+    p.input(*juliaReader);
+
+    PointTable nativeTable;
+    native->prepare(nativeTable);
+    PointViewPtr expected = *native->execute(nativeTable).begin();
+
+    PointTable table;
+    PointViewPtr view = *p.execute(table).begin();
+
+    ASSERT_EQ(view->size(), expected->size());
+    Dimension::Id density = table.layout()->findDim("RadialDensity");
+    Dimension::Id nativeDensity =
+        nativeTable.layout()->findDim("RadialDensity");
+    for (PointId idx = 0; idx < view->size(); ++idx)
+        EXPECT_NEAR(view->getFieldAs<double>(density, idx),
+            expected->getFieldAs<double>(nativeDensity, idx), 1e-9);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_unpackError)
+{
+    // A dimension that doesn't exist fails while the result is unpacked
+    JuliaPipeline p(JuliaPipeline::source("module BadDimModule\n"
+                   "  using TypedTables\n"
+                   "  bad(ins) = Table(ins; Missing = ins.X)\n"
+                   "end\n", "BadDimModule", "bad"));
+    p.ramp(10);
+
+    PointTable table;
+    EXPECT_THROW(p.execute(table), pdal_error);
+
+    // Julia's GC roots were left as they were, so collecting afterwards
+    // is safe
+    JuliaPipeline p2(JuliaPipeline::source("module CollectModule\n"
+                   "  sweep(ins) = (GC.gc(); ins)\n"
+                   "end\n", "CollectModule", "sweep"));
+    p2.ramp(10);
+
+    PointTable table2;
+    PointViewSet viewSet = p2.execute(table2);
+    EXPECT_EQ((*viewSet.begin())->size(), 10u);
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_lazyColumns)
+{
+    // Columns that aren't Vectors, such as ranges, views and BitVectors,
+    // are collected before they're written back
+    Options opts = JuliaPipeline::source("module LazyModule\n"
+                   "  using TypedTables\n"
+                   "  lazy(ins) = Table(ins; Z = 1.0:length(ins), "
+                   "X = view(ins.Y, :), Flag = ins.Y .> 0.5)\n"
+                   "end\n", "LazyModule", "lazy");
+    opts.add("add_dimension", "Flag=uint8");
+    JuliaPipeline p(opts);
+    p.ramp(10);
+
+    PointTable table;
+    PointViewPtr view = *p.execute(table).begin();
+    ASSERT_EQ(view->size(), 10u);
+    Dimension::Id flag = table.layout()->findDim("Flag");
+    for (PointId idx = 0; idx < view->size(); ++idx)
+    {
+        double y = view->getFieldAs<double>(Dimension::Id::Y, idx);
+        EXPECT_DOUBLE_EQ(view->getFieldAs<double>(Dimension::Id::Z, idx),
+            idx + 1.0);
+        EXPECT_DOUBLE_EQ(view->getFieldAs<double>(Dimension::Id::X, idx), y);
+        EXPECT_EQ(view->getFieldAs<int>(flag, idx), y > 0.5 ? 1 : 0);
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_functionError)
+{
+    // An error thrown by the function fails the stage with its message,
+    // run whole or in parallel, and the process carries on
+    for (bool parallel : { false, true })
+    {
+        Options opts = JuliaPipeline::source("module ThrowModule\n"
+                       "  fail(ins) = error(\"no points wanted\")\n"
+                       "end\n", "ThrowModule", "fail");
+        opts.add("parallel", parallel);
+        JuliaPipeline p(opts);
+        p.ramp(10);
+
+        PointTable table;
+        try
+        {
+            p.execute(table);
+            FAIL() << "Expected the function's error";
+        }
+        catch (const pdal_error& err)
+        {
+            EXPECT_NE(std::string(err.what()).find("no points wanted"),
+                std::string::npos) << err.what();
+        }
+    }
+}
+
+TEST_F(JuliaFilterTest, JuliaFilterTest_outOfRange)
+{
+    // Values that don't fit the dimension's type fail rather than wrap, and
+    // values in range are rounded to the nearest
+    for (const std::string value : { "300.0", "NaN", "-1.0", "254.6" })
+    {
+        Options opts = JuliaPipeline::source("module RangeModule\n"
+                       "  using TypedTables\n"
+                       "  small(ins) = Table(ins; Small = fill(" + value +
+                           ", length(ins)))\n"
+                       "end\n", "RangeModule", "small");
+        opts.add("add_dimension", "Small=uint8");
+        JuliaPipeline p(opts);
+        p.ramp(10);
+
+        PointTable table;
+        if (value != "254.6")
+        {
+            EXPECT_THROW(p.execute(table), pdal_error) << value;
+            continue;
+        }
+
+        PointViewPtr view = *p.execute(table).begin();
+        Dimension::Id small = table.layout()->findDim("Small");
+        for (PointId idx = 0; idx < view->size(); ++idx)
+            EXPECT_EQ(view->getFieldAs<int>(small, idx), 255);
+    }
+}
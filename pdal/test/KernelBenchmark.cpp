@@ -0,0 +1,175 @@
+/*****************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <pdal/PointTable.hpp>
+#include <pdal/PointView.hpp>
+
+#include "../jlang/Kernels.hpp"
+#include "../jlang/ViewStorage.hpp"
+
+using namespace pdal;
+using namespace pdal::jlang;
+
+namespace
+{
+
+template<typename Table>
+PointViewPtr makeView(Table& table, point_count_t count)
+{
+    PointLayoutPtr layout(table.layout());
+    layout->registerDim(Dimension::Id::X);
+    layout->registerDim(Dimension::Id::Y);
+    layout->registerDim(Dimension::Id::Z);
+    layout->registerDim(Dimension::Id::Intensity);
+
+    PointViewPtr view(new PointView(table));
+    for (PointId idx = 0; idx < count; ++idx)
+    {
+        view->setField(Dimension::Id::X, idx, (double)idx);
+        view->setField(Dimension::Id::Y, idx, (double)idx);
+        view->setField(Dimension::Id::Z, idx, (double)idx);
+        view->setField(Dimension::Id::Intensity, idx, (uint16_t)idx);
+    }
+    return view;
+}
+
+} // unnamed namespace
+
+// The previous marshal-in path: one getField() call per point
+template<typename Table>
+static void BM_GetField(benchmark::State& state)
+{
+    Table table;
+    point_count_t count = state.range(0);
+    PointViewPtr view = makeView(table, count);
+    std::vector<double> buf(count);
+
+    for (auto _ : state)
+    {
+        char *p = (char *)buf.data();
+        for (PointId idx = 0; idx < count; ++idx)
+        {
+            view->getField(p, Dimension::Id::X, Dimension::Type::Double, idx);
+            p += sizeof(double);
+        }
+        benchmark::DoNotOptimize(buf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * count * sizeof(double));
+}
+BENCHMARK_TEMPLATE(BM_GetField, PointTable)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_GetField, ColumnPointTable)->Range(1 << 10, 1 << 22);
+
+template<typename Table>
+static void BM_Gather(benchmark::State& state)
+{
+    Table table;
+    point_count_t count = state.range(0);
+    PointViewPtr view = makeView(table, count);
+    const Dimension::Detail *dd = view->layout()->dimDetail(Dimension::Id::X);
+    std::vector<double> buf(count);
+
+    for (auto _ : state)
+    {
+        ViewStorage storage(*view);
+        storage.gather(dd, Dimension::Type::Double, (char *)buf.data());
+        benchmark::DoNotOptimize(buf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * count * sizeof(double));
+}
+BENCHMARK_TEMPLATE(BM_Gather, PointTable)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_Gather, ColumnPointTable)->Range(1 << 10, 1 << 22);
+
+// The previous marshal-out path: one setField() call per point
+template<typename Table>
+static void BM_SetField(benchmark::State& state)
+{
+    Table table;
+    point_count_t count = state.range(0);
+    PointViewPtr view = makeView(table, count);
+    std::vector<float> buf(count, 1.0f);
+
+    for (auto _ : state)
+    {
+        for (PointId idx = 0; idx < count; ++idx)
+            view->setField(Dimension::Id::X, idx, buf[idx]);
+    }
+    state.SetBytesProcessed(state.iterations() * count * sizeof(float));
+}
+BENCHMARK_TEMPLATE(BM_SetField, PointTable)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_SetField, ColumnPointTable)->Range(1 << 10, 1 << 22);
+
+template<typename Table>
+static void BM_Scatter(benchmark::State& state)
+{
+    Table table;
+    point_count_t count = state.range(0);
+    PointViewPtr view = makeView(table, count);
+    const Dimension::Detail *dd = view->layout()->dimDetail(Dimension::Id::X);
+    std::vector<float> buf(count, 1.0f);
+
+    for (auto _ : state)
+    {
+        ViewStorage storage(*view);
+        storage.scatter(dd, Dimension::Type::Float, (const char *)buf.data(),
+            count);
+    }
+    state.SetBytesProcessed(state.iterations() * count * sizeof(float));
+}
+BENCHMARK_TEMPLATE(BM_Scatter, PointTable)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_Scatter, ColumnPointTable)->Range(1 << 10, 1 << 22);
+
+// The kernels alone, on packed buffers
+template<typename Src, typename Dst>
+static void BM_Transfer(benchmark::State& state)
+{
+    point_count_t count = state.range(0);
+    std::vector<Src> src(count, Src(1));
+    std::vector<Dst> dst(count);
+    TransferFn fn = transferKernel(typeIndex<Src>(), typeIndex<Dst>());
+
+    for (auto _ : state)
+    {
+        fn((const char *)src.data(), sizeof(Src), (char *)dst.data(),
+            sizeof(Dst), count);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetBytesProcessed(state.iterations() * count * sizeof(Src));
+}
+BENCHMARK_TEMPLATE(BM_Transfer, double, double)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_Transfer, float, double)->Range(1 << 10, 1 << 22);
+BENCHMARK_TEMPLATE(BM_Transfer, double, uint16_t)->Range(1 << 10, 1 << 22);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,84 @@
+/******************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#include <pdal/pdal_test_main.hpp>
+
+#include "../jlang/Kernels.hpp"
+
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+using namespace pdal;
+
+
+#ifndef _WIN32
+// Point counts past 2^31 go through the kernels whole. The source is
+// reserved but never written apart from its last page, so it reads as
+// zeros without taking up memory, and the destinations have no stride, so
+// each is a single byte.
+//
+// This covers the kernels only. ViewStorageTest runs a table that size
+// through ViewStorage's gather and scatter.
+TEST(KernelsTest, over2GPoints)
+{
+    if (sizeof(std::size_t) < 8)
+        return;
+
+    const point_count_t count = (point_count_t(1) << 31) + 16;
+    void *mem = mmap(nullptr, count + 1, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    ASSERT_NE(mem, MAP_FAILED);
+    char *src = (char *)mem;
+    src[count - 1] = 7;
+    src[count] = 9;
+
+    char first = 0;
+    char second = 0;
+    std::vector<jlang::Span> spans { { &first, 0, count }, { &second, 0, 1 } };
+    const std::size_t u8 = jlang::typeIndex<uint8_t>();
+    jlang::scatter(src, 1, jlang::transferKernel(u8, u8), spans, count + 1);
+    EXPECT_EQ(first, 7);
+    EXPECT_EQ(second, 9);
+
+    // A change past 2^31 bytes shows in the checksum of a column
+    uint64_t before = jlang::checksum(src, count);
+    src[count - 2] = 1;
+    EXPECT_NE(jlang::checksum(src, count), before);
+
+    munmap(mem, count + 1);
+}
+#endif
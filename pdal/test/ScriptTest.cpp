@@ -0,0 +1,61 @@
+/******************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+
+#include <pdal/pdal_test_main.hpp>
+
+#include "../jlang/Script.hpp"
+
+using namespace pdal;
+
+
+TEST(ScriptTest, referencedDims)
+{
+    StringList dims { "X", "Y", "Z", "Intensity" };
+    auto referenced = [&dims](const std::string& source)
+    {
+        return jlang::Script(source, "M", "f").referencedDims(dims);
+    };
+
+    // Names in comments don't count, names in strings do
+    EXPECT_EQ(referenced("f(t) = (t.X .= 1; t) # Y\n#= Z #= Y =# =#\n"),
+        StringList { "X" });
+    EXPECT_EQ(referenced("f(t) = t[findfirst(==(\"Z\"), n)] # X"),
+        StringList { "Z" });
+    EXPECT_EQ(referenced("f(t) = t.Xs"), StringList {});
+
+    // Columns reached dynamically pass everything
+    EXPECT_EQ(referenced("f(t) = getproperty(t, Symbol(\"Int\", \"ensity\"))"),
+        dims);
+    EXPECT_EQ(referenced("f(t) = [sum(v) for v in values(t)]"), dims);
+}
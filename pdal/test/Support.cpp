@@ -45,6 +45,7 @@
 #include <pdal/PDALUtils.hpp>
 #include <pdal/Stage.hpp>
 #include <pdal/StageFactory.hpp>
+#include <pdal/Streamable.hpp>
 #include "TestConfig.hpp"
 
 using namespace pdal;
@@ -413,3 +414,82 @@ void Support::compareBounds(const BOX3D& p, const BOX3D& q)
     EXPECT_DOUBLE_EQ(p.maxz, q.maxz);
 }
 
+
+JuliaPipeline::JuliaPipeline(const Options& opts) :
+    m_filter(m_factory.createStage("filters.julia")),
+    m_stats(new StatsFilter)
+{
+    if (!m_filter)
+        throw pdal_error("Unable to create filters.julia");
+    m_filter->setOptions(opts);
+    m_stats->setInput(*m_filter);
+}
+
+
+Options JuliaPipeline::source(const std::string& src,
+    const std::string& module, const std::string& function)
+{
+    Options opts;
+    opts.add("source", src);
+    opts.add("module", module);
+    opts.add("function", function);
+    return opts;
+}
+
+
+Options JuliaPipeline::script(const std::string& file,
+    const std::string& module, const std::string& function)
+{
+    Options opts;
+    opts.add("script", file);
+    opts.add("module", module);
+    opts.add("function", function);
+    return opts;
+}
+
+
+Options JuliaPipeline::rampOptions(point_count_t count, double min,
+    double max)
+{
+    Options ops;
+    ops.add("bounds", BOX3D(min, min, min, max, max, max));
+    ops.add("count", count);
+    ops.add("mode", "ramp");
+    return ops;
+}
+
+
+JuliaPipeline& JuliaPipeline::ramp(point_count_t count, double min,
+    double max)
+{
+    m_readers.emplace_back(new FauxReader);
+    m_readers.back()->setOptions(rampOptions(count, min, max));
+    return input(*m_readers.back());
+}
+
+
+JuliaPipeline& JuliaPipeline::input(Stage& stage)
+{
+    m_filter->setInput(stage);
+    return *this;
+}
+
+
+PointViewSet JuliaPipeline::execute(BasePointTable& table)
+{
+    m_stats->prepare(table);
+    return m_stats->execute(table);
+}
+
+
+void JuliaPipeline::execute(StreamPointTable& table)
+{
+    m_stats->prepare(table);
+    m_stats->execute(table);
+}
+
+
+MetadataNode JuliaPipeline::timings() const
+{
+    return m_filter->getMetadata().findChild("timings");
+}
@@ -37,15 +37,23 @@
 // support functions for unit testing
 
 #include <pdal/pdal_types.hpp>
+#include <pdal/Options.hpp>
+#include <pdal/PointView.hpp>
+#include <pdal/StageFactory.hpp>
+#include <pdal/filters/StatsFilter.hpp>
+#include <pdal/io/FauxReader.hpp>
 
 namespace pdal
 {
     class PointView;
     class Stage;
     class BOX3D;
+    class StreamPointTable;
 }
 
+#include <memory>
 #include <string>
+#include <vector>
 
 class Support
 {
@@ -144,3 +152,44 @@ public:
     // static int run_command(const std::string& cmd, std::string& output);
 };
 
+
+// A filters.julia stage and its inputs, with a stats filter after it, as
+// most of the stage's tests run it
+class JuliaPipeline
+{
+public:
+    JuliaPipeline(const pdal::Options& opts);
+
+    // Options to run the function of the module in the source, or in the
+    // script file
+    static pdal::Options source(const std::string& src,
+        const std::string& module, const std::string& function);
+    static pdal::Options script(const std::string& file,
+        const std::string& module, const std::string& function);
+
+    // Options of a FauxReader of count points ramping from min to max in
+    // X, Y and Z
+    static pdal::Options rampOptions(pdal::point_count_t count,
+        double min = 0.0, double max = 1.0);
+
+    // Adds an input of such points
+    JuliaPipeline& ramp(pdal::point_count_t count, double min = 0.0,
+        double max = 1.0);
+    JuliaPipeline& input(pdal::Stage& stage);
+
+    // Prepares and runs the pipeline on the table
+    pdal::PointViewSet execute(pdal::BasePointTable& table);
+    void execute(pdal::StreamPointTable& table);
+
+    pdal::Stage& filter()
+        { return *m_filter; }
+    const pdal::stats::Summary& stats(pdal::Dimension::Id dim) const
+        { return m_stats->getStats(dim); }
+    pdal::MetadataNode timings() const;
+
+private:
+    pdal::StageFactory m_factory;
+    std::vector<std::unique_ptr<pdal::FauxReader>> m_readers;
+    pdal::Stage *m_filter;
+    std::unique_ptr<pdal::StatsFilter> m_stats;
+};
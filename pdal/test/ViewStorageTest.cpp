@@ -0,0 +1,180 @@
+/******************************************************************************
+* Copyright (c) 2020, Julian Fell (hi@jtfell.com)
+*
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following
+* conditions are met:
+*
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in
+*       the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of Hobu, Inc. or Flaxen Geo Consulting nor the
+*       names of its contributors may be used to endorse or promote
+*       products derived from this software without specific prior
+*       written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+* FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+* COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+* INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+* BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+* OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+* AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+* OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+* OF SUCH DAMAGE.
+****************************************************************************/
+#include <pdal/pdal_test_main.hpp>
+
+#include <pdal/PointTable.hpp>
+
+#include "../jlang/ViewStorage.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace pdal;
+
+
+#ifndef _WIN32
+namespace
+{
+
+// Memory of which every whole MiB maps the same MiB of a file, and the rest
+// is its own. Writing all of it takes a MiB or so, and only what comes after
+// the last whole MiB tells a copy that stops short from one that doesn't.
+// The process's resident size counts the MiB once per mapping of it, but
+// only the page tables take memory beyond it.
+class AliasedMemory
+{
+public:
+    static const std::size_t Chunk = std::size_t(1) << 20;
+
+    AliasedMemory(std::size_t size)
+    {
+        const std::size_t page = (std::size_t)::sysconf(_SC_PAGESIZE);
+        m_mapped = (size + page - 1) / page * page;
+        void *p = ::mmap(nullptr, m_mapped, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED)
+            throw pdal_error("Unable to reserve memory");
+        m_data = (char *)p;
+
+        char name[] = "/tmp/pdal-julia-test-XXXXXX";
+        int fd = ::mkstemp(name);
+        if (fd < 0)
+            throw pdal_error("Unable to create file to map");
+        ::unlink(name);
+        if (::ftruncate(fd, Chunk) != 0)
+            throw pdal_error("Unable to size file to map");
+
+        const std::size_t aliased = size / Chunk * Chunk;
+        for (std::size_t offset = 0; offset < aliased; offset += Chunk)
+            if (::mmap(m_data + offset, Chunk, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+                throw pdal_error("Unable to map file");
+        ::close(fd);
+        if (m_mapped > aliased && ::mmap(m_data + aliased, m_mapped - aliased,
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS |
+                MAP_FIXED, -1, 0) == MAP_FAILED)
+            throw pdal_error("Unable to map memory");
+    }
+
+    ~AliasedMemory()
+    {
+        ::munmap(m_data, m_mapped);
+    }
+
+    char *data() const
+    {
+        return m_data;
+    }
+
+private:
+    char *m_data;
+    std::size_t m_mapped;
+};
+
+// A row-major table of points already laid out in memory
+class MappedTable : public SimplePointTable
+{
+public:
+    MappedTable(char *data) : SimplePointTable(m_layout), m_data(data)
+    {}
+
+protected:
+    virtual char *getPoint(PointId idx)
+    {
+        return m_data + pointsToBytes(idx);
+    }
+
+private:
+    virtual PointId addPoint()
+    {
+        throw pdal_error("Points can't be added to a mapped table");
+    }
+
+    PointLayout m_layout;
+    char *m_data;
+};
+
+} // unnamed namespace
+
+// A table past 2^31 points is gathered into a column and scattered back
+// whole, including the points past 2^31 and values past 2^32 bytes into
+// the column. Each point is a byte, widened to two in the column.
+TEST(ViewStorageTest, over2GPoints)
+{
+    if (sizeof(std::size_t) < 8)
+        return;
+
+    const point_count_t count = (point_count_t(1) << 31) + 16;
+    const point_count_t tail = count - 16;
+    AliasedMemory points(count);
+    AliasedMemory column(2 * count);
+
+    MappedTable table(points.data());
+    table.layout()->registerDim(Dimension::Id::Classification);
+    table.finalize();
+    const Dimension::Detail *dd =
+        table.layout()->dimDetail(Dimension::Id::Classification);
+
+    uint8_t *values = (uint8_t *)points.data();
+    std::fill(values, values + AliasedMemory::Chunk, 5);
+    for (point_count_t i = tail; i < count; ++i)
+        values[i] = uint8_t(100 + i - tail);
+
+    // The points are one run of memory
+    jlang::ViewStorage storage(table, 0, count);
+    std::vector<jlang::Span> spans = storage.spans(dd);
+    ASSERT_EQ(spans.size(), 1u);
+    EXPECT_EQ(spans[0].m_count, count);
+
+    uint16_t *gathered = (uint16_t *)column.data();
+    storage.gather(dd, Dimension::Type::Unsigned16, column.data(), spans);
+    EXPECT_EQ(gathered[0], 5u);
+    EXPECT_EQ(gathered[tail - 1], 5u);
+    for (point_count_t i = tail; i < count; ++i)
+        EXPECT_EQ(gathered[i], 100 + i - tail);
+
+    for (point_count_t i = tail; i < count; ++i)
+        gathered[i] += 50;
+    storage.scatter(dd, Dimension::Type::Unsigned16, column.data(), count,
+        spans);
+    EXPECT_EQ(values[0], 5u);
+    for (point_count_t i = tail; i < count; ++i)
+        EXPECT_EQ(values[i], 150 + i - tail);
+}
+#endif
@@ -0,0 +1,56 @@
+#
+# Helpers shared by the benchmark scripts.
+#
+
+# A JSON string literal. Quotes, backslashes and control characters are escaped, the last as
+# \u00XX, and everything else is written as UTF-8.
+function jsonString(s::AbstractString)
+  io = IOBuffer()
+  print(io, '"')
+  for c in s
+    if c == '"'
+      print(io, "\\\"")
+    elseif c == '\\'
+      print(io, "\\\\")
+    elseif c < ' '
+      print(io, "\\u", string(UInt32(c), base = 16, pad = 4))
+    else
+      print(io, c)
+    end
+  end
+  print(io, '"')
+  return String(take!(io))
+end
+
+json(x::Nothing) = "null"
+json(x::Bool) = string(x)
+json(x::Real) = isfinite(x) ? string(x) : "null"
+json(x::AbstractString) = jsonString(x)
+json(x::AbstractVector) = "[" * join(json.(x), ", ") * "]"
+json(x::NamedTuple) = "{" * join(("$(json(string(k))): $(json(v))" for (k, v) in pairs(x)), ", ") * "}"
+json(x::AbstractDict) = "{" * join(("$(json(string(k))): $(json(v))" for (k, v) in x), ", ") * "}"
+
+# Set `options` from `--name value` pairs in ARGS, failing on names it has no default for
+function parseOptions!(options::AbstractDict)
+  for i = 1:2:length(ARGS)
+    key = replace(ARGS[i], "--" => "")
+    haskey(options, key) && i < length(ARGS) || error("unknown option $(ARGS[i])")
+    options[key] = ARGS[i + 1]
+  end
+  return options
+end
+
+# Wall clock time of a whole `pdal pipeline` run of the pipeline JSON, or nothing if it failed. With
+# `metadata`, the run's metadata is also written to that file.
+function timePipeline(pdal, pipelineJson; metadata = nothing)
+  file = tempname() * ".json"
+  write(file, pipelineJson)
+  cmd = metadata === nothing ? `$pdal pipeline $file` : `$pdal pipeline $file --metadata $metadata`
+  try
+    start = time_ns()
+    success(pipeline(cmd, stdout = devnull, stderr = devnull)) || return nothing
+    return (time_ns() - start) / 1e9
+  finally
+    rm(file, force = true)
+  end
+end
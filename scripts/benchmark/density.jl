@@ -0,0 +1,129 @@
+#
+# Radial density benchmark of the PdalJulia runtime's kernel against filters.radialdensity.
+#
+# Both compute RadialDensity within the same radius over each input, and are followed by
+# filters.stats so their results can be compared. The inputs are LAS files, and synthetic clouds of
+# random points from readers.faux spread at about the density of a typical airborne survey. A run
+# of the reader alone is timed too and subtracted, so each time is the filter's own.
+#
+#   julia scripts/benchmark/density.jl [--files pdal/test/data/autzen.las] [--sizes 10000000]
+#                                      [--radius 5] [--threads 0] [--repeats 3] [--pdal pdal]
+#                                      [--out density-results.json]
+#
+# `threads` is passed to filters.julia, and 0 leaves it to JULIA_NUM_THREADS. filters.julia needs
+# PDAL_DRIVER_PATH set as for any pipeline. Results are written as JSON.
+#
+
+using Dates
+using Statistics
+
+include("common.jl")
+
+const options = Dict(
+  "files" => joinpath(@__DIR__, "..", "..", "pdal", "test", "data", "autzen.las"),
+  "sizes" => "10000000",
+  "radius" => "5",
+  "threads" => "0",
+  "repeats" => "3",
+  "pdal" => "pdal",
+  "out" => "density-results.json")
+
+parseOptions!(options)
+
+const files = filter(!isempty, String.(split(options["files"], ',')))
+const sizes = [parse(Int, s) for s in split(options["sizes"], ',') if !isempty(s)]
+const radius = parse(Float64, options["radius"])
+const threads = parse(Int, options["threads"])
+const repeats = parse(Int, options["repeats"])
+const pdal = options["pdal"]
+
+const juliaSource = """
+module Density
+  using PdalJulia
+  function density(ins)
+    radialDensity!(ins.RadialDensity, ins.X, ins.Y, ins.Z, $radius)
+    return ins
+  end
+end
+"""
+
+const stages = Dict(
+  "none" => nothing,
+  "julia" => """{ "type": "filters.julia", "source": $(json(juliaSource)), "module": "Density",
+    "function": "density", "add_dimension": "RadialDensity"$(threads > 0 ? ", \"threads\": $threads" : "") }""",
+  "native" => """{ "type": "filters.radialdensity", "radius": $radius }""")
+
+# About 10 points a square metre, 30 metres deep
+function reader(input)
+  input isa AbstractString && return """{ "type": "readers.las", "filename": $(json(abspath(input))) }"""
+  side = round(Int, sqrt(input / 10))
+  return """{ "type": "readers.faux", "count": $input, "mode": "random", "bounds": "([0, $side], [0, $side], [0, 30])" }"""
+end
+
+function pipelineJson(name, input)
+  stats = """{ "type": "filters.stats", "dimensions": "RadialDensity" }"""
+  stage = stages[name]
+  parts = stage === nothing ? [reader(input)] : [reader(input), stage, stats]
+  return "[ " * join([parts; """{ "type": "writers.null" }"""], ", ") * " ]"
+end
+
+# Wall clock time of a whole `pdal pipeline` run and the mean density it found, or nothing if it failed
+function timeRun(name, input)
+  metadata = tempname() * ".json"
+  try
+    seconds = timePipeline(pdal, pipelineJson(name, input), metadata = metadata)
+    seconds === nothing && return nothing
+    # The stats of RadialDensity, whichever order its fields are in
+    text = read(metadata, String)
+    m = match(r"\"name\":\s*\"RadialDensity\"[^}]*?\"average\":\s*([-0-9.eE+]+)"s, text)
+    m === nothing && (m = match(r"\"average\":\s*([-0-9.eE+]+)[^}]*?\"name\":\s*\"RadialDensity\""s, text))
+    return (seconds = seconds, mean = m === nothing ? nothing : parse(Float64, m.captures[1]))
+  finally
+    rm(metadata, force = true)
+  end
+end
+
+results = []
+for input in [files; sizes]
+  label = input isa AbstractString ? basename(input) : "faux $input"
+  medians = Dict{String, Float64}()
+  means = Dict{String, Any}()
+  for name in ["none", "native", "julia"]
+    runs = [r for r in (timeRun(name, input) for _ = 1:repeats) if r !== nothing]
+    if isempty(runs)
+      println("$label $name: failed")
+      continue
+    end
+    medians[name] = median([r.seconds for r in runs])
+    means[name] = runs[1].mean
+    println("$label $name: $(round(medians[name], digits = 3))s")
+  end
+
+  filterTime(name) = haskey(medians, name) && haskey(medians, "none") ? medians[name] - medians["none"] : nothing
+  native, julia = filterTime("native"), filterTime("julia")
+  push!(results, (
+    input = label,
+    seconds = Dict(k => v for (k, v) in medians),
+    native_s = native,
+    julia_s = julia,
+    speedup = native === nothing || julia === nothing || julia <= 0 ? nothing : native / julia,
+    mean_density = Dict(k => v for (k, v) in means if k != "none")))
+end
+
+write(options["out"], json(Dict(
+  "date" => string(now()),
+  "pdal" => readchomp(`$pdal --version`),
+  "radius" => radius,
+  "threads" => threads,
+  "repeats" => repeats,
+  "results" => results)) * "\n")
+println("Results written to $(options["out"])")
+
+# The same results as a table to paste into the README
+fmt(x) = x === nothing ? "-" : string(round(x, digits = 3))
+println("\n| Input | filters.radialdensity (s) | radialDensity! (s) | Speedup | Mean density (native / Julia) |")
+println("|---|---|---|---|---|")
+for r in results
+  println("| $(r.input) | $(fmt(r.native_s)) | $(fmt(r.julia_s)) | $(fmt(r.speedup)) | ",
+    "$(fmt(get(r.mean_density, "native", nothing))) / $(fmt(get(r.mean_density, "julia", nothing))) |")
+end
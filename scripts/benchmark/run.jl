@@ -0,0 +1,116 @@
+#
+# End-to-end scaling benchmark of filters.julia against filters.python and a native C++ stage.
+#
+# Each filter doubles X into Y over a synthetic cloud from readers.faux, written to writers.null,
+# for 1e4 to 1e8 points. A pipeline without the filter is timed at each size too, and subtracted,
+# so what's left is the filter's own time. A line fitted through those times separates startup (the
+# intercept) from steady-state throughput (the slope), and the fits give the size at which Julia
+# breaks even with each of the others.
+#
+#   julia scripts/benchmark/run.jl [--sizes 10000,100000] [--repeats 3] [--filters julia,python]
+#                                  [--pdal pdal] [--out results.json]
+#
+# filters.julia needs PDAL_DRIVER_PATH set as for any pipeline. Results are written as JSON.
+#
+
+using Dates
+using Statistics
+
+include("common.jl")
+
+const options = Dict(
+  "sizes" => "10000,100000,1000000,10000000,100000000",
+  "repeats" => "3",
+  "filters" => "julia,python,native",
+  "pdal" => "pdal",
+  "out" => "benchmark-results.json")
+
+parseOptions!(options)
+
+const sizes = parse.(Int, split(options["sizes"], ','))
+const repeats = parse(Int, options["repeats"])
+const pdal = options["pdal"]
+
+const juliaSource = """
+module Bench
+  function update(ins)
+    ins.Y .= ins.X .* 2
+    return ins
+  end
+end
+"""
+
+const pythonSource = """
+def update(ins, outs):
+    outs['Y'] = ins['X'] * 2
+    return True
+"""
+
+# Each filter as a pipeline stage, as JSON. The native one is a transformation whose second row
+# sets Y to 2X.
+const stages = Dict(
+  "none" => nothing,
+  "julia" => """{ "type": "filters.julia", "source": $(json(juliaSource)), "module": "Bench", "function": "update" }""",
+  "python" => """{ "type": "filters.python", "source": $(json(pythonSource)), "module": "anything", "function": "update" }""",
+  "native" => """{ "type": "filters.transformation", "matrix": "1 0 0 0 2 0 0 0 0 0 1 0 0 0 0 1" }""")
+
+function pipelineJson(name, points)
+  reader = """{ "type": "readers.faux", "count": $points, "mode": "ramp", "bounds": "([0, 1000], [0, 1000], [0, 100])" }"""
+  writer = """{ "type": "writers.null" }"""
+  stage = stages[name]
+  return "[ " * join(stage === nothing ? [reader, writer] : [reader, stage, writer], ", ") * " ]"
+end
+
+timeRun(name, points) = timePipeline(pdal, pipelineJson(name, points))
+
+# Least-squares fit of t = startup + points / throughput
+function fit(points, seconds)
+  length(points) < 2 && return nothing
+  x, y = Float64.(points), Float64.(seconds)
+  slope = cov(x, y) / var(x)
+  startup = mean(y) - slope * mean(x)
+  return (startup = startup, throughput = slope > 0 ? 1 / slope : Inf)
+end
+
+# The size at which a's fitted time falls to b's, if it does
+function breakEven(a, b)
+  (a === nothing || b === nothing) && return nothing
+  perPoint = 1 / b.throughput - 1 / a.throughput
+  n = (a.startup - b.startup) / perPoint
+  return perPoint > 0 && n > 0 ? round(Int, n) : nothing
+end
+
+filters = String.(split(options["filters"], ','))
+runs = []
+medians = Dict{Tuple{String, Int}, Float64}()
+for points in sizes, name in ["none"; filters]
+  seconds = Float64[t for t in (timeRun(name, points) for _ = 1:repeats) if t !== nothing]
+  push!(runs, (filter = name, points = points, seconds = seconds))
+  if isempty(seconds)
+    println("$name $points: failed")
+  else
+    medians[(name, points)] = median(seconds)
+    println("$name $points: $(round(median(seconds), digits = 3))s")
+  end
+end
+
+# Fits of the time each filter adds to the pipeline without it
+fits = Dict{String, Any}()
+for name in filters
+  done = [n for n in sizes if haskey(medians, (name, n)) && haskey(medians, ("none", n))]
+  fits[name] = fit(done, [medians[(name, n)] - medians[("none", n)] for n in done])
+end
+
+breaksEven = Dict("julia_vs_$other" => breakEven(get(fits, "julia", nothing), fits[other])
+  for other in filters if other != "julia")
+
+write(options["out"], json(Dict(
+  "date" => string(now()),
+  "pdal" => readchomp(`$pdal --version`),
+  "sizes" => sizes,
+  "repeats" => repeats,
+  "runs" => runs,
+  "fits" => Dict(k => v === nothing ? nothing : (startup_s = v.startup, points_per_s = v.throughput)
+    for (k, v) in fits),
+  "break_even_points" => breaksEven)) * "\n")
+println("Results written to $(options["out"])")